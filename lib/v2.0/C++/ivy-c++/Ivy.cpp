@@ -222,6 +222,15 @@ int Ivy::SendMsg(const char *fmt, ... )
   return res;
 }
 
+int Ivy::SendRawMsg(const char *message)
+{
+  LOCK(ivyMutex)
+	/* IvySendMsg always formats, "%s" makes it a plain copy (and keeps any '%' in message) */
+	auto res = IvyC::IvySendMsg ("%s", message);
+  UNLOCK(ivyMutex)
+  return res;
+}
+
 
 /*
 #         ______                      _    _____     _                         _
@@ -14,6 +14,7 @@ namespace IvyC
  #include <Ivy/ivysocket.h>
  #include <Ivy/ivy.h>
  #include <Ivy/ivybuffer.h>
+ #include <Ivy/timer.h>
 }
 #include "IvyCallback.h"
 
@@ -43,6 +44,9 @@ public:
   static int  SendMsg(const char *fmt, ... )
 	  __attribute__((format(printf,1,2))) ;
 
+  /* Send an already formatted message, without formatting it again */
+  static int  SendRawMsg(const char *message);
+
   static void SendDirectMsg( IvyApplication *app, int id,
 				   const char *message);
 
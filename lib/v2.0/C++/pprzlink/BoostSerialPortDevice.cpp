@@ -24,33 +24,201 @@
 
 
 #include "BoostSerialPortDevice.h"
+#include "exceptions/pprzlink_exception.h"
 #include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
 #include <iostream>
 #include <functional>
 
 namespace pprzlink {
 
   BoostSerialPortDevice::BoostSerialPortDevice(boost::asio::io_service &ioService, std::string serialPortName)
-    : ioService(ioService), serialPort(ioService, serialPortName),availBytes(0)
+    : ioService(ioService), serialPort(ioService, serialPortName), writePos(0), readPos(0), receivingOverflow(false),
+      droppedBytes(0), writtenBytes(0), writeInProgress(false), maxWriteQueueSize(BOOSTSERIAL_WRITE_QUEUE_SIZE),
+      writeQueueHighWater(0), droppedWriteBytes(0), writeOverflowPolicy(WriteOverflowPolicy::DROP_NEW),
+      portGuard(std::make_shared<PortGuard>())
   {}
 
+  BoostSerialPortDevice::~BoostSerialPortDevice()
+  {
+    // Once closed is set no handler uses the device anymore, the pending operations complete with
+    // operation_canceled without touching the port
+    std::lock_guard<std::mutex> lock(portGuard->mutex);
+    portGuard->closed = true;
+    boost::system::error_code ignored;
+    serialPort.close(ignored);
+  }
+
+  template<typename Handler>
+  auto BoostSerialPortDevice::guarded(Handler handler)
+  {
+    return [guard = portGuard, handler](auto &&... args) {
+      std::lock_guard<std::mutex> lock(guard->mutex);
+      if (!guard->closed)
+      {
+        handler(std::forward<decltype(args)>(args)...);
+      }
+    };
+  }
+
   size_t BoostSerialPortDevice::availableBytes()
   {
-    return availBytes;
+    return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_relaxed);
   }
 
   BytesBuffer BoostSerialPortDevice::readAll()
   {
-    auto tmp = availBytes;
-    availBytes=0;
-    serialPort.cancel();
-    startReception();
-    return BytesBuffer(buffer.begin(),buffer.begin()+tmp);
+    BytesBuffer data;
+    readInto(data);
+    return data;
+  }
+
+  size_t BoostSerialPortDevice::readInto(BytesBuffer &data)
+  {
+    const size_t begin = readPos.load(std::memory_order_relaxed);
+    const size_t end = writePos.load(std::memory_order_acquire);
+    const size_t count = end - begin;
+    if (count == 0)
+    {
+      return 0;
+    }
+
+    // The available bytes may wrap around the end of the ring
+    const size_t first = begin % BOOSTSERIAL_BUFFER_SIZE;
+    const size_t firstCount = std::min(count, BOOSTSERIAL_BUFFER_SIZE - first);
+    data.insert(data.end(), buffer.begin() + first, buffer.begin() + first + firstCount);
+    data.insert(data.end(), buffer.begin(), buffer.begin() + (count - firstCount));
+
+    // Hand the space back to the reception handler
+    readPos.store(end, std::memory_order_release);
+    return count;
   }
 
   void BoostSerialPortDevice::writeBuffer(const BytesBuffer &data)
   {
-    serialPort.write_some(boost::asio::buffer(data));
+    std::lock_guard<std::mutex> lock(writeMutex);
+    const size_t pending = queuedBuffer.size() + writingBuffer.size();
+    // Data larger than the queue is still written when nothing else is pending, so that it can ever be sent
+    if (pending != 0 && pending + data.size() > maxWriteQueueSize)
+    {
+      if (writeOverflowPolicy == WriteOverflowPolicy::DROP_QUEUED)
+      {
+        droppedWriteBytes += queuedBuffer.size();
+        queuedBuffer.clear();
+      }
+      else
+      {
+        droppedWriteBytes += data.size();
+        throw write_queue_full("Write queue of " + std::to_string(pending) + " bytes full, " +
+                               std::to_string(data.size()) + " bytes dropped");
+      }
+    }
+
+    queuedBuffer.insert(queuedBuffer.end(), data.begin(), data.end());
+    writeQueueHighWater = std::max(writeQueueHighWater, queuedBuffer.size() + writingBuffer.size());
+    if (!writeInProgress)
+    {
+      // The write is started from the io_service so that the serial port is only used from there
+      writeInProgress = true;
+      ioService.post(guarded(std::bind(&BoostSerialPortDevice::startWrite, this)));
+    }
+  }
+
+  void BoostSerialPortDevice::startWrite()
+  {
+    {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      std::swap(queuedBuffer, writingBuffer);
+    }
+    writtenBytes = 0;
+    writeSome();
+  }
+
+  void BoostSerialPortDevice::writeSome()
+  {
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    // Not boost::asio::async_write, which would use the port between the handlers, out of portGuard
+    serialPort.async_write_some(boost::asio::buffer(writingBuffer.data() + writtenBytes, writingBuffer.size() - writtenBytes),
+                                guarded(std::bind(&BoostSerialPortDevice::dataWrittenHandler, this, _1, _2)));
+  }
+
+  void BoostSerialPortDevice::dataWrittenHandler(const boost::system::error_code &error, std::size_t bytes_transferred)
+  {
+    if (error.value() == boost::system::errc::errc_t::operation_canceled)
+    {
+      // The port is being closed
+      return;
+    }
+    if (!error)
+    {
+      writtenBytes += bytes_transferred;
+      if (writtenBytes < writingBuffer.size())
+      {
+        writeSome();
+        return;
+      }
+    }
+    bool writeNext;
+    {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      writingBuffer.clear();
+      writeNext = !queuedBuffer.empty() && !error;
+      writeInProgress = writeNext;
+    }
+    if (error)
+    {
+      // As for reception, the error is reported, the next writeBuffer starts a new write
+      raiseError(boost::system::system_error(error), false);
+      return;
+    }
+    if (writeNext)
+    {
+      // writeInProgress is still set, so writeBuffer does not start another write
+      startWrite();
+    }
+  }
+
+  size_t BoostSerialPortDevice::getWriteQueueSize()
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return queuedBuffer.size() + writingBuffer.size();
+  }
+
+  size_t BoostSerialPortDevice::getWriteQueueHighWater()
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return writeQueueHighWater;
+  }
+
+  size_t BoostSerialPortDevice::getDroppedWriteBytes()
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return droppedWriteBytes;
+  }
+
+  size_t BoostSerialPortDevice::getMaxWriteQueueSize()
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return maxWriteQueueSize;
+  }
+
+  void BoostSerialPortDevice::setMaxWriteQueueSize(size_t size)
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    maxWriteQueueSize = size;
+  }
+
+  BoostSerialPortDevice::WriteOverflowPolicy BoostSerialPortDevice::getWriteOverflowPolicy()
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return writeOverflowPolicy;
+  }
+
+  void BoostSerialPortDevice::setWriteOverflowPolicy(BoostSerialPortDevice::WriteOverflowPolicy policy)
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    writeOverflowPolicy = policy;
   }
 
   const BoostSerialPortDevice::Baudrate &BoostSerialPortDevice::getBaudrate() const
@@ -61,6 +229,7 @@ namespace pprzlink {
   void BoostSerialPortDevice::setBaudrate(const BoostSerialPortDevice::Baudrate &baudrate)
   {
     BoostSerialPortDevice::baudrate = baudrate;
+    std::lock_guard<std::mutex> lock(portGuard->mutex);
     serialPort.set_option(baudrate);
   }
 
@@ -72,6 +241,7 @@ namespace pprzlink {
   void BoostSerialPortDevice::setDataBits(const BoostSerialPortDevice::DataBits &dataBits)
   {
     BoostSerialPortDevice::dataBits = dataBits;
+    std::lock_guard<std::mutex> lock(portGuard->mutex);
     serialPort.set_option(dataBits);
   }
 
@@ -83,6 +253,7 @@ namespace pprzlink {
   void BoostSerialPortDevice::setParity(const BoostSerialPortDevice::Parity &parity)
   {
     BoostSerialPortDevice::parity = parity;
+    std::lock_guard<std::mutex> lock(portGuard->mutex);
     serialPort.set_option(parity);
   }
 
@@ -94,6 +265,7 @@ namespace pprzlink {
   void BoostSerialPortDevice::setStopBits(const BoostSerialPortDevice::StopBits &stopBits)
   {
     BoostSerialPortDevice::stopBits = stopBits;
+    std::lock_guard<std::mutex> lock(portGuard->mutex);
     serialPort.set_option(stopBits);
   }
 
@@ -105,33 +277,72 @@ namespace pprzlink {
   void BoostSerialPortDevice::setFlowcontrol(const BoostSerialPortDevice::Flowcontrol &flowcontrol)
   {
     BoostSerialPortDevice::flowcontrol = flowcontrol;
+    std::lock_guard<std::mutex> lock(portGuard->mutex);
     serialPort.set_option(flowcontrol);
   }
 
+  size_t BoostSerialPortDevice::getDroppedBytes() const
+  {
+    return droppedBytes.load(std::memory_order_relaxed);
+  }
+
   void
   BoostSerialPortDevice::dataReceptionHandler(const boost::system::error_code &error, std::size_t bytes_transferred)
   {
     if (!error)
     {
-      availBytes += bytes_transferred;
+      if (receivingOverflow)
+      {
+        droppedBytes.fetch_add(bytes_transferred, std::memory_order_relaxed);
+      }
+      else if (bytesCallback)
+      {
+        // The bytes are consumed at once, the ring stays empty
+        bytesCallback(buffer.data() + writePos.load(std::memory_order_relaxed) % BOOSTSERIAL_BUFFER_SIZE,
+                      bytes_transferred);
+      }
+      else
+      {
+        // Publish the received bytes to the reader
+        writePos.store(writePos.load(std::memory_order_relaxed) + bytes_transferred, std::memory_order_release);
+      }
 
       // Continue waiting for data
-      startReception();
+      receive();
     }
     else
     {
-      // If the error is anything else than a cancelation of the operation throw the corresponding system_error
+      // If the error is anything else than a cancelation of the operation report the corresponding system_error,
+      // the reception stops
       if (error.value() != boost::system::errc::errc_t::operation_canceled)
       {
-        throw boost::system::system_error(error);
+        raiseError(boost::system::system_error(error), true);
       }
     }
   }
 
   void BoostSerialPortDevice::startReception()
+  {
+    std::lock_guard<std::mutex> lock(portGuard->mutex);
+    receive();
+  }
+
+  void BoostSerialPortDevice::receive()
   {
     using std::placeholders::_1;
     using std::placeholders::_2;
-    serialPort.async_read_some(boost::asio::buffer(buffer.begin()+availBytes, BOOSTSERIAL_BUFFER_SIZE - availBytes), std::bind(&BoostSerialPortDevice::dataReceptionHandler, this, _1, _2));
+    const size_t begin = writePos.load(std::memory_order_relaxed);
+    const size_t free = BOOSTSERIAL_BUFFER_SIZE - (begin - readPos.load(std::memory_order_acquire));
+    receivingOverflow = (free == 0);
+    if (receivingOverflow)
+    {
+      // Keep reading so that the port never stalls, these bytes will be dropped
+      serialPort.async_read_some(boost::asio::buffer(overflowBuffer), guarded(std::bind(&BoostSerialPortDevice::dataReceptionHandler, this, _1, _2)));
+      return;
+    }
+    // Receive into the contiguous free space after the write position
+    const size_t first = begin % BOOSTSERIAL_BUFFER_SIZE;
+    const size_t size = std::min(free, BOOSTSERIAL_BUFFER_SIZE - first);
+    serialPort.async_read_some(boost::asio::buffer(buffer.data() + first, size), guarded(std::bind(&BoostSerialPortDevice::dataReceptionHandler, this, _1, _2)));
   }
-}
\ No newline at end of file
+}
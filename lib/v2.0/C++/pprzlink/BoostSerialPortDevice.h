@@ -30,10 +30,38 @@
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/serial_port.hpp>
 #include <boost/asio/streambuf.hpp>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
-#define BOOSTSERIAL_BUFFER_SIZE (1024)
+#ifndef BOOSTSERIAL_BUFFER_SIZE
+#define BOOSTSERIAL_BUFFER_SIZE (16384) // Must be a power of 2
+#endif
+
+#ifndef BOOSTSERIAL_WRITE_QUEUE_SIZE
+#define BOOSTSERIAL_WRITE_QUEUE_SIZE (4096)
+#endif
 
 namespace pprzlink {
+  /**
+   * Serial port device receiving continuously in the background.
+   *
+   * Once startReception has been called, the bytes are received into a ring buffer by the thread running the
+   * io_service, while another thread reads them with readAll or readInto. When the ring is full the incoming bytes are
+   * dropped and counted (see getDroppedBytes), reception never stops. With a bytes callback (see
+   * Device::setBytesCallback), the bytes are pushed to it from the io_service thread instead.
+   *
+   * writeBuffer does not block either: the data is queued and written by the thread running the io_service, so the
+   * io_service must be running for anything to be sent.
+   *
+   * The errors of the reception and of the writes are thrown from the io_service, unless an error callback is set
+   * (see Device::setErrorCallback).
+   *
+   * The device may be destroyed while the io_service is running: the destructor waits for the handler running on the
+   * device, if any, and closes the port, the handlers called afterwards do nothing. It must not be destroyed from its
+   * own callbacks.
+   */
   class BoostSerialPortDevice : public Device {
   public:
     using Baudrate = boost::asio::serial_port_base::baud_rate;
@@ -42,14 +70,62 @@ namespace pprzlink {
     using DataBits = boost::asio::serial_port_base::character_size;
     using Flowcontrol = boost::asio::serial_port_base::flow_control;
 
+    /// What to do when writeBuffer is called with a full write queue
+    enum class WriteOverflowPolicy {
+      DROP_NEW, ///< Drop the data being written, writeBuffer throws write_queue_full
+      DROP_QUEUED ///< Drop the data waiting in the queue (but not the one being written) to queue the new data
+    };
+
     BoostSerialPortDevice(boost::asio::io_service &ioService, std::string serialPortName);
 
+    ~BoostSerialPortDevice() override;
+
     size_t availableBytes() override;
 
     BytesBuffer readAll() override;
 
+    size_t readInto(BytesBuffer &data) override;
+
+    /**
+     * Queue data to be written, the call does not wait for the data to be sent.
+     * Queued chunks are merged and written by a single asynchronous write at a time. Data larger than the maximum
+     * size of the queue is accepted when nothing is queued nor being written.
+     *
+     * @param data
+     * @throws write_queue_full if the data is dropped because the queue is full (see WriteOverflowPolicy)
+     */
     void writeBuffer(BytesBuffer const &data) override;
 
+    /**
+     *
+     * @return the number of bytes queued or being written
+     */
+    [[nodiscard]] size_t getWriteQueueSize();
+
+    /**
+     *
+     * @return the maximum value reached by getWriteQueueSize
+     */
+    [[nodiscard]] size_t getWriteQueueHighWater();
+
+    /**
+     *
+     * @return the number of bytes dropped because the write queue was full
+     */
+    [[nodiscard]] size_t getDroppedWriteBytes();
+
+    [[nodiscard]] size_t getMaxWriteQueueSize();
+
+    /**
+     *
+     * @param size maximum number of bytes queued or being written
+     */
+    void setMaxWriteQueueSize(size_t size);
+
+    [[nodiscard]] WriteOverflowPolicy getWriteOverflowPolicy();
+
+    void setWriteOverflowPolicy(WriteOverflowPolicy policy);
+
     [[nodiscard]] const Baudrate &getBaudrate() const;
 
     void setBaudrate(const Baudrate &baudrate);
@@ -70,11 +146,34 @@ namespace pprzlink {
 
     void setFlowcontrol(const Flowcontrol &flowcontrol);
 
+    /**
+     *
+     * @return the number of bytes received while the ring buffer was full
+     */
+    [[nodiscard]] size_t getDroppedBytes() const;
+
     void startReception();
 
     void dataReceptionHandler(const boost::system::error_code& error, std::size_t bytes_transferred);
 
   protected:
+    void startWrite(); // Only called from the io_service
+
+    void writeSome(); // Idem, writes the rest of writingBuffer
+
+    void dataWrittenHandler(const boost::system::error_code& error, std::size_t bytes_transferred);
+
+    void receive(); // Called with portGuard locked
+
+    // Shared with the handlers given to the io_service, which may be called after the device is destroyed
+    struct PortGuard {
+      std::mutex mutex; // Held by the handlers and by the other uses of serialPort
+      bool closed = false; // Set by the destructor, the handlers called after it do nothing
+    };
+
+    template<typename Handler>
+    auto guarded(Handler handler); // Wraps a handler given to the io_service
+
     boost::asio::io_service &ioService;
     boost::asio::serial_port serialPort;
     Baudrate baudrate;
@@ -82,8 +181,29 @@ namespace pprzlink {
     Parity parity;
     StopBits stopBits;
     Flowcontrol flowcontrol;
+    static_assert((BOOSTSERIAL_BUFFER_SIZE & (BOOSTSERIAL_BUFFER_SIZE - 1)) == 0, "BOOSTSERIAL_BUFFER_SIZE must be a power of 2");
+
+    // Single producer (reception handler) single consumer (readAll/readInto) ring buffer. The positions only grow, the
+    // index in the buffer is the position modulo its size.
     std::array<uint8_t,BOOSTSERIAL_BUFFER_SIZE> buffer;
-    size_t availBytes;
+    std::atomic<size_t> writePos; // Written by the reception handler only
+    std::atomic<size_t> readPos; // Written by the reader only
+    std::array<uint8_t,256> overflowBuffer; // Receives the bytes to drop when the ring is full
+    bool receivingOverflow;
+    std::atomic<size_t> droppedBytes;
+
+    // Write queue, everything below is protected by writeMutex (except writingBuffer while a write is in progress)
+    std::mutex writeMutex;
+    BytesBuffer queuedBuffer; // Filled by writeBuffer
+    BytesBuffer writingBuffer; // Being written, swapped with queuedBuffer when a write starts
+    size_t writtenBytes; // Bytes of writingBuffer already written, only used from the io_service
+    bool writeInProgress;
+    size_t maxWriteQueueSize;
+    size_t writeQueueHighWater;
+    size_t droppedWriteBytes;
+    WriteOverflowPolicy writeOverflowPolicy;
+
+    std::shared_ptr<PortGuard> portGuard;
   };
 }
 #endif //PPRZLINKCPP_BOOSTSERIALPORTDEVICE_H
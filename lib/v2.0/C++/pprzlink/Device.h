@@ -28,6 +28,8 @@
 #include <cstdint>
 #include <functional>
 #include <deque>
+#include <exception>
+#include <vector>
 
 /*
 using check_free_space_t = std::function<int(void *, long *, uint16_t)>;
@@ -48,11 +50,77 @@ namespace pprzlink {
    */
   class Device {
   public:
+    /// Called with the bytes received, in order
+    using BytesCallback = std::function<void(const uint8_t *data, size_t length)>;
+
+    /// Called with an error of the background reception or writing, and whether the reception stopped because of it
+    using ErrorCallback = std::function<void(const std::exception &error, bool receptionStopped)>;
+
+    virtual ~Device() = default;
+
     virtual size_t availableBytes() = 0;
 
     virtual BytesBuffer readAll() = 0;
 
+    /**
+     * Append all available bytes at the end of buffer.
+     * The default implementation goes through readAll, devices should override it to avoid the intermediate buffer.
+     *
+     * @param buffer
+     * @return the number of bytes appended
+     */
+    virtual size_t readInto(BytesBuffer &buffer)
+    {
+      auto bytes = readAll();
+      buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+      return bytes.size();
+    }
+
     virtual void writeBuffer(BytesBuffer const &data) = 0;
+
+    /**
+     * Push the received bytes to callback as soon as they arrive, instead of keeping them for readAll.
+     * Only devices receiving in the background call it (from the thread running their io_service), it must be set
+     * before the reception is started. Other devices ignore it.
+     *
+     * @param callback
+     */
+    virtual void setBytesCallback(BytesCallback callback)
+    {
+      bytesCallback = std::move(callback);
+    }
+
+    /**
+     * Pass the errors of the background reception and writing to callback, instead of throwing them from the
+     * io_service (which stops it for all its users). Other devices ignore it.
+     *
+     * @param callback
+     */
+    virtual void setErrorCallback(ErrorCallback callback)
+    {
+      errorCallback = std::move(callback);
+    }
+
+  protected:
+    /**
+     * Report an error of a background operation to the error callback, or throw it if there is none.
+     *
+     * @tparam Error
+     * @param error
+     * @param receptionStopped
+     */
+    template<typename Error>
+    void raiseError(const Error &error, bool receptionStopped)
+    {
+      if (!errorCallback)
+      {
+        throw error;
+      }
+      errorCallback(error, receptionStopped);
+    }
+
+    BytesCallback bytesCallback;
+    ErrorCallback errorCallback;
   };
 }
 #endif //PPRZLINKCPP_DEVICE_H
@@ -22,265 +22,172 @@
  *
  */
 #include <pprzlink/FieldValue.h>
+#include <pprzlink/MessageCodec.h>
+#include <pprzlink/exceptions/pprzlink_exception.h>
 #include <iomanip>
+#include <charconv>
+#include <algorithm>
+#include <optional>
 
-// FIXME This should go to a SERIALISER !
-std::ostream& operator<<(std::ostream& o,const pprzlink::FieldValue& v)
-{
-  const auto& type=v.getType();
-  const auto& name=v.getName();
-  if (type.isArray())
+namespace {
+  template<typename T> struct is_vector : std::false_type {};
+  template<typename T> struct is_vector<std::vector<T>> : std::true_type {};
+
+  template<typename T>
+  void printElement(std::ostream &o, T val, bool int8AsInt)
   {
-    switch (type.getBaseType())
+    if constexpr (std::is_same<T, int8_t>::value || std::is_same<T, uint8_t>::value)
     {
-      case pprzlink::BaseType::NOT_A_TYPE:
-        throw std::logic_error("NOT_A_TYPE for field "+name);
-        break;
-      case pprzlink::BaseType::CHAR:
-      {
-        std::vector<char> vec;
-        v.getValue(vec);
-        o << "\"";
-        for (size_t i=0;i<vec.size();++i)
-        {
-          o << vec[i];
-        }
-        o << "\"";
-      }
-        break;
-      case pprzlink::BaseType::INT8:
-      {
-        std::vector<int8_t> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          if (v.isOutputInt8AsInt())
-            o << (int)vec[i];
-          else
-            o << vec[i];
-        }
-      }
-        break;
-      case pprzlink::BaseType::INT16:
-      {
-        std::vector<int16_t> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          o << vec[i];
-        }
-      }
-        break;
-      case pprzlink::BaseType::INT32:
-      {
-        std::vector<int32_t> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          o << vec[i];
-        }
-      }
-        break;
-      case pprzlink::BaseType::UINT8:
-      {
-        std::vector<uint8_t> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          if (v.isOutputInt8AsInt())
-            o << (int)vec[i];
-          else
-            o << vec[i];
-        }
-      }
-        break;
-      case pprzlink::BaseType::UINT16:
-      {
-        std::vector<uint16_t> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          o << vec[i];
-        }
-      }
-        break;
-      case pprzlink::BaseType::UINT32:
-      {
-        std::vector<uint32_t> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          o << vec[i];
-        }
-      }
-        break;
-      case pprzlink::BaseType::FLOAT:
-      {
-        std::vector<float> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          o << std::fixed << vec[i];
-        }
-      }
-        break;
-      case pprzlink::BaseType::DOUBLE:
-      {
-        std::vector<double> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          o << std::fixed << vec[i];
-        }
-      }
-        break;
-      case pprzlink::BaseType::STRING:
-      {
-        std::vector<std::string> vec;
-        v.getValue(vec);
-        for (size_t i=0;i<vec.size();++i)
-        {
-          if (i!=0)
-            o << ",";
-          o << vec[i];
-        }
-      }
-        break;
+      if (int8AsInt)
+        o << (int)val;
+      else
+        o << val;
+    }
+    else if constexpr (std::is_floating_point<T>::value)
+    {
+      o << std::fixed << val;
+    }
+    else
+    {
+      o << val;
     }
   }
-  else
+
+  /**
+   * Parse a whole number with from_chars. Integers given in floating point (or out of range) are converted from a
+   * double, as a binding sending every number as a double would expect.
+   */
+  template<typename T>
+  bool parseNumber(std::string_view text, T &val)
   {
-    switch (type.getBaseType())
+    if (!text.empty() && text.front() == '+')
     {
-      case pprzlink::BaseType::NOT_A_TYPE:
-        throw std::logic_error("NOT_A_TYPE for field "+name);
-        break;
-      case pprzlink::BaseType::CHAR:
-      {
-        char val;
-        v.getValue(val);
-        o << val;
-      }
-        break;
-      case pprzlink::BaseType::INT8:
-      {
-        int8_t val;
-        v.getValue(val);
-        if (v.isOutputInt8AsInt())
-        {
-          o << (int)val;
-        }
-        else
-        {
-          o << val;
-        }
-      }
-        break;
-      case pprzlink::BaseType::INT16:
-      {
-        int16_t val;
-        v.getValue(val);
-          o << val;
-      }
-        break;
-      case pprzlink::BaseType::INT32:
-      {
-        int32_t val;
-        v.getValue(val);
-        o << val;
-      }
-        break;
-      case pprzlink::BaseType::UINT8:
-      {
-        uint8_t val;
-        v.getValue(val);
-        if (v.isOutputInt8AsInt())
-        {
-          o << (int)val;
-        }
-        else
-        {
-          o << val;
-        }
-      }
-        break;
-      case pprzlink::BaseType::UINT16:
-      {
-        uint16_t val;
-        v.getValue(val);
-        o << val;
-      }
-        break;
-      case pprzlink::BaseType::UINT32:
+      text.remove_prefix(1);
+    }
+    const char *last = text.data() + text.size();
+    auto [end, error] = std::from_chars(text.data(), last, val);
+    if (error == std::errc() && end == last)
+    {
+      return true;
+    }
+    if constexpr (std::is_integral<T>::value)
+    {
+      double d;
+      auto [dEnd, dError] = std::from_chars(text.data(), last, d);
+      if (dError == std::errc() && dEnd == last)
       {
-        uint32_t val;
-        v.getValue(val);
-        o << val;
+        val = static_cast<T>(static_cast<int64_t>(d));
+        return true;
       }
-        break;
-      case pprzlink::BaseType::FLOAT:
+    }
+    return false;
+  }
+
+  /**
+   * Append a number as printElement writes it with int8AsInt.
+   */
+  template<typename T>
+  void appendNumber(std::string &out, T val)
+  {
+    char digits[32];
+    std::to_chars_result result;
+    if constexpr (std::is_floating_point<T>::value)
+    {
+      result = std::to_chars(digits, digits + sizeof(digits), val, std::chars_format::fixed, 6);
+      if (result.ec == std::errc::value_too_large)
       {
-        float val;
-        v.getValue(val);
-        o  << std::fixed << val;
+        // Up to 309 digits before the point for a double
+        char large[400];
+        result = std::to_chars(large, large + sizeof(large), val, std::chars_format::fixed, 6);
+        out.append(large, result.ptr);
+        return;
       }
-        break;
-      case pprzlink::BaseType::DOUBLE:
+    }
+    else if constexpr (std::is_same<T, char>::value)
+    {
+      out.push_back(val);
+      return;
+    }
+    else
+    {
+      result = std::to_chars(digits, digits + sizeof(digits), static_cast<int64_t>(val));
+    }
+    out.append(digits, result.ptr);
+  }
+}
+
+// FIXME This should go to a SERIALISER !
+std::ostream& operator<<(std::ostream& o,const pprzlink::FieldValue& v)
+{
+  std::visit([&](const auto &val) {
+    using T = std::decay_t<decltype(val)>;
+    if constexpr (std::is_same<T, std::monostate>::value)
+    {
+      throw pprzlink::field_has_no_value("Field " + v.getName() + " has no value");
+    }
+    else if constexpr (std::is_same<T, std::vector<char>>::value)
+    {
+      o << "\"";
+      for (auto c : val)
       {
-        double val;
-        v.getValue(val);
-        o  << std::fixed << val;
+        o << c;
       }
-        break;
-      case pprzlink::BaseType::STRING:
+      o << "\"";
+    }
+    else if constexpr (is_vector<T>::value)
+    {
+      for (size_t i=0;i<val.size();++i)
       {
-        std::string val;
-        v.getValue(val);
-        o << val;
+        if (i!=0)
+          o << ",";
+        printElement(o, val[i], v.isOutputInt8AsInt());
       }
-        break;
     }
-  }
+    else
+    {
+      printElement(o, val, v.isOutputInt8AsInt());
+    }
+  }, v.getValue());
 
   return o;
 }
 namespace pprzlink {
+  const std::shared_ptr<const MessageField> &FieldValue::placeholderField()
+  {
+    static const auto placeholder = std::make_shared<const MessageField>("", "char");
+    return placeholder;
+  }
+
+  std::shared_ptr<const MessageField> FieldValue::ownField(const MessageField &field)
+  {
+    return std::make_shared<const MessageField>(field);
+  }
+
   const MessageField &FieldValue::getField() const
   {
-    return field;
+    return *field;
   }
 
   const FieldType &FieldValue::getType() const
   {
-    return field.getType();
+    return field->getType();
   }
 
   const std::string &FieldValue::getName() const
   {
-    return field.getName();
+    return field->getName();
   }
 
-  const std::any &FieldValue::getValue() const
+  const FieldStorage &FieldValue::getValue() const
   {
     return value;
   }
 
+  bool FieldValue::hasValue() const
+  {
+    return !std::holds_alternative<std::monostate>(value);
+  }
+
   bool FieldValue::isOutputInt8AsInt() const
   {
     return output_int8_as_int;
@@ -293,232 +200,150 @@ namespace pprzlink {
 
   size_t FieldValue::addToBuffer(BytesBuffer &buffer) const
   {
-    size_t initialSize=buffer.size();
-    if (getType().isArray())
+    std::optional<FieldCodec> ownCodec;
+    const auto &fieldCodec = codec ? *codec : ownCodec.emplace(*field);
+    size_t size = fieldCodec.getEncodedSize(value);
+    buffer.resize(buffer.size() + size);
+    return fieldCodec.encode(value, buffer.data() + buffer.size() - size);
+  }
+
+  void FieldValue::readFromBuffer(const uint8_t *data, size_t length, size_t &offset)
+  {
+    std::optional<FieldCodec> ownCodec;
+    const auto &fieldCodec = codec ? *codec : ownCodec.emplace(*field);
+    fieldCodec.decode(value, data, length, offset);
+  }
+
+  void FieldValue::readFromText(std::string_view text)
+  {
+    if (text.size() >= 2 && text.front() == '"' && text.back() == '"')
     {
-      auto vec = std::any_cast < std::vector < std::any >> (value);
-      if (getType().getArraySize()==0) // Variable length array
-      {
-        // TODO Check that the length is in number of elements not in bytes
-        buffer.push_back(vec.size()); // Add the length of the array in number of elements
-      }
-      for (auto elem : vec)
-      {
-        switch (getType().getBaseType())
-        {
-          case BaseType::CHAR:
-          {
-            char val = std::any_cast<char>(elem);
-            buffer.push_back(val);
-          }
-            break;
-          case BaseType::INT8:
-          {
-            char val = std::any_cast<int8_t>(elem);
-            buffer.push_back(val);
-          }
-            break;
-          case BaseType::INT16:
-          {
-            char val = std::any_cast<int16_t>(elem);
-            buffer.push_back(val & 0x00FFu);
-            buffer.push_back((val & 0xFF00u) >> 8u);
-          }
-            break;
-          case BaseType::INT32:
-          {
-            char val = std::any_cast<int32_t>(elem);
-            buffer.push_back(val & 0x000000FFu);
-            buffer.push_back((val & 0x0000FF00u) >> 8u);
-            buffer.push_back((val & 0x00FF0000u) >> 16u);
-            buffer.push_back((val & 0xFF000000u) >> 24u);
-          }
-            break;
-          case BaseType::UINT8:
-          {
-            char val = std::any_cast<uint8_t>(elem);
-            buffer.push_back(val);
-          }
-            break;
-          case BaseType::UINT16:
-          {
-            char val = std::any_cast<uint16_t>(elem);
-            buffer.push_back(val & 0x00FFu);
-            buffer.push_back((val & 0xFF00u) >> 8u);
-          }
-            break;
-          case BaseType::UINT32:
-          {
-            char val = std::any_cast<uint32_t>(elem);
-            buffer.push_back(val & 0x000000FFu);
-            buffer.push_back((val & 0x0000FF00u) >> 8u);
-            buffer.push_back((val & 0x00FF0000u) >> 16u);
-            buffer.push_back((val & 0xFF000000u) >> 24u);
-          }
-            break;
-          case BaseType::FLOAT:
-          {
-            char val = std::any_cast<float>(elem);
-            uint32_t *ptrval = (uint32_t *) &val;
-            buffer.push_back(*ptrval & 0x000000FFu);
-            buffer.push_back((*ptrval & 0x0000FF00u) >> 8u);
-            buffer.push_back((*ptrval & 0x00FF0000u) >> 16u);
-            buffer.push_back((*ptrval & 0xFF000000u) >> 24u);
-          }
-            break;
-          case BaseType::DOUBLE:
-          {
-            char val = std::any_cast<double>(elem);
-            uint64_t *ptrval = (uint64_t *) &val;
-            buffer.push_back(*ptrval & 0x00000000000000FFu);
-            buffer.push_back((*ptrval & 0x000000000000FF00u) >> 8u);
-            buffer.push_back((*ptrval & 0x0000000000FF0000u) >> 16u);
-            buffer.push_back((*ptrval & 0x00000000FF000000u) >> 24u);
-            buffer.push_back((*ptrval & 0x000000FF00000000u) >> 32u);
-            buffer.push_back((*ptrval & 0x0000FF0000000000u) >> 40u);
-            buffer.push_back((*ptrval & 0x00FF000000000000u) >> 48u);
-            buffer.push_back((*ptrval & 0xFF00000000000000u) >> 56u);
-          }
-            break;
-          case BaseType::STRING:
-            throw std::logic_error("Cannot add an array of STRING to a buffer for field " + getName());
-            break;
-          case BaseType::NOT_A_TYPE:
-            throw std::logic_error("Cannot add a field of type NOT_A_TYPE to a buffer for field " + getName());
-        }
-      }
+      text = text.substr(1, text.size() - 2);
     }
-    else //      if (!getType().isArray())
+    const auto &type = field->getType();
+    switch (type.getBaseType())
     {
-      switch (getType().getBaseType())
-      {
-        case BaseType::CHAR:
-        {
-          char val;
-          getValue(val);
-          buffer.push_back(val);
-        }
-          break;
-        case BaseType::INT8:
-        {
-          int8_t val;
-          getValue(val);
-          buffer.push_back(val);
-        }
-          break;
-        case BaseType::INT16:
-        {
-          int16_t val;
-          getValue(val);
-          buffer.push_back(val & 0x00FFu);
-          buffer.push_back((val & 0xFF00u) >> 8u);
-        }
-          break;
-        case BaseType::INT32:
-        {
-          int32_t val;
-          getValue(val);
-          buffer.push_back(val & 0x000000FFu);
-          buffer.push_back((val & 0x0000FF00u) >> 8u);
-          buffer.push_back((val & 0x00FF0000u) >> 16u);
-          buffer.push_back((val & 0xFF000000u) >> 24u);
-        }
-          break;
-        case BaseType::UINT8:
-        {
-          uint8_t val;
-          getValue(val);
-          buffer.push_back(val);
-        }
-          break;
-        case BaseType::UINT16:
-        {
-          uint16_t val;
-          getValue(val);
-          buffer.push_back(val & 0x00FFu);
-          buffer.push_back((val & 0xFF00u) >> 8u);
-        }
-          break;
-        case BaseType::UINT32:
-        {
-          uint32_t val;
-          getValue(val);
-          buffer.push_back(val & 0x000000FFu);
-          buffer.push_back((val & 0x0000FF00u) >> 8u);
-          buffer.push_back((val & 0x00FF0000u) >> 16u);
-          buffer.push_back((val & 0xFF000000u) >> 24u);
-        }
-          break;
-        case BaseType::FLOAT:
+      case BaseType::NOT_A_TYPE:
+        throw std::logic_error("Field " + getName() + " as type NOT_A_TYPE");
+      case BaseType::STRING:
+        value = std::string(text);
+        break;
+      case BaseType::CHAR:
+        if (type.isArray())
         {
-          float val;
-          getValue(val);
-          uint32_t *ptrval = (uint32_t *) &val;
-          buffer.push_back(*ptrval & 0x000000FFu);
-          buffer.push_back((*ptrval & 0x0000FF00u) >> 8u);
-          buffer.push_back((*ptrval & 0x00FF0000u) >> 16u);
-          buffer.push_back((*ptrval & 0xFF000000u) >> 24u);
+          if (type.getArraySize() && type.getArraySize() != text.size())
+          {
+            throw wrong_message_format("Wrong size for char array " + getName() + ": \"" + std::string(text) + "\"");
+          }
+          value = std::vector<char>(text.begin(), text.end());
         }
-          break;
-        case BaseType::DOUBLE:
+        else
         {
-          double val;
-          getValue(val);
-          uint64_t *ptrval = (uint64_t *) &val;
-          buffer.push_back(*ptrval & 0x00000000000000FFu);
-          buffer.push_back((*ptrval & 0x000000000000FF00u) >> 8u);
-          buffer.push_back((*ptrval & 0x0000000000FF0000u) >> 16u);
-          buffer.push_back((*ptrval & 0x00000000FF000000u) >> 24u);
-          buffer.push_back((*ptrval & 0x000000FF00000000u) >> 32u);
-          buffer.push_back((*ptrval & 0x0000FF0000000000u) >> 40u);
-          buffer.push_back((*ptrval & 0x00FF000000000000u) >> 48u);
-          buffer.push_back((*ptrval & 0xFF00000000000000u) >> 56u);
+          value = text.empty() ? '\0' : text.front();
         }
-          break;
-        case BaseType::STRING:
+        break;
+      case BaseType::INT8:
+        readNumbersFromText<int8_t>(text);
+        break;
+      case BaseType::INT16:
+        readNumbersFromText<int16_t>(text);
+        break;
+      case BaseType::INT32:
+        readNumbersFromText<int32_t>(text);
+        break;
+      case BaseType::UINT8:
+        readNumbersFromText<uint8_t>(text);
+        break;
+      case BaseType::UINT16:
+        readNumbersFromText<uint16_t>(text);
+        break;
+      case BaseType::UINT32:
+        readNumbersFromText<uint32_t>(text);
+        break;
+      case BaseType::FLOAT:
+        readNumbersFromText<float>(text);
+        break;
+      case BaseType::DOUBLE:
+        readNumbersFromText<double>(text);
+        break;
+    }
+  }
+
+  void FieldValue::appendText(std::string &out) const
+  {
+    std::visit([&](const auto &val) {
+      using T = std::decay_t<decltype(val)>;
+      if constexpr (std::is_same<T, std::monostate>::value)
+      {
+        throw pprzlink::field_has_no_value("Field " + getName() + " has no value");
+      }
+      else if constexpr (std::is_same<T, std::string>::value)
+      {
+        out += val;
+      }
+      else if constexpr (std::is_same<T, std::vector<char>>::value)
+      {
+        out.push_back('"');
+        out.append(val.begin(), val.end());
+        out.push_back('"');
+      }
+      else if constexpr (is_vector<T>::value)
+      {
+        for (size_t i = 0; i < val.size(); ++i)
         {
-          // A string is encoded as a variable char array (char[])
-          std::string val;
-          getValue(val);
-          buffer.push_back(val.length());
-          for (auto c: val)
+          if (i != 0)
           {
-            buffer.push_back((uint8_t) c);
+            out.push_back(',');
           }
+          appendNumber(out, val[i]);
         }
-          break;
-        case BaseType::NOT_A_TYPE:
-          throw std::logic_error("Cannot add a field of type NOT_A_TYPE to a buffer for field " + getName());
       }
-    }
-    return buffer.size() - initialSize;
+      else
+      {
+        appendNumber(out, val);
+      }
+    }, value);
   }
 
-  size_t FieldValue::getByteSize() const
+  template<typename T>
+  void FieldValue::readNumbersFromText(std::string_view text)
   {
-    size_t elemSize = sizeofBaseType(getType().getBaseType());
-    size_t size;
-    if (getType().getBaseType() == BaseType::STRING)
+    const auto &type = field->getType();
+    if (!type.isArray())
     {
-      elemSize = 1;
-    }
-    if (getType().isArray())
-    {
-      auto vec = std::any_cast<std::vector<std::any>>(value);
-      size= elemSize * vec.size();
-      if (getType().getArraySize()==0) // If variable length array add one for the length
-        size++;
+      T val;
+      if (!parseNumber(text, val))
+      {
+        throw wrong_message_format("Wrong number \"" + std::string(text) + "\" for field " + getName());
+      }
+      value = val;
+      return;
     }
-    else if (getType().getBaseType() == BaseType::STRING)// String is considered as char[]
+
+    auto &values = value.emplace<std::vector<T>>();
+    values.reserve(std::count(text.begin(), text.end(), ',') + 1);
+    while (!text.empty())
     {
-      auto str = std::any_cast<std::string>(value);
-      size= elemSize*str.length() +1; // String is a vraiable length array
+      const size_t comma = text.find(',');
+      T val;
+      if (!parseNumber(text.substr(0, comma), val))
+      {
+        throw wrong_message_format("Wrong format for array " + getName() + ": \"" + std::string(text) + "\"");
+      }
+      values.push_back(val);
+      text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
     }
-    else
+    if (type.getArraySize() && type.getArraySize() != values.size())
     {
-      size=elemSize;
+      throw wrong_message_format("Wrong size for array " + getName() + ", got " + std::to_string(values.size()) +
+                                 " / expected " + std::to_string(type.getArraySize()));
     }
+  }
 
-    return size;
+  size_t FieldValue::getByteSize() const
+  {
+    std::optional<FieldCodec> ownCodec;
+    const auto &fieldCodec = codec ? *codec : ownCodec.emplace(*field);
+    return fieldCodec.getEncodedSize(value);
   }
 }
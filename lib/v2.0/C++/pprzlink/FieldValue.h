@@ -27,15 +27,32 @@
 #define PPRZLINKCPP_FIELDVALUE_H
 
 #include <pprzlink/MessageField.h>
-#include <any>
+#include <variant>
 #include <vector>
 #include <array>
 #include <stdexcept>
 #include <sstream>
+#include <string_view>
 #include <cstdint>
+#include <iterator>
+#include <memory>
 #include "Device.h"
 
 namespace pprzlink {
+  class FieldCodec;
+
+  /**
+   * Tagged storage of a field value.
+   * Alternative i (1 to 10) holds a scalar of BaseType i, alternative i+10 holds an array of BaseType i.
+   * std::monostate means that no value has been set yet.
+   */
+  using FieldStorage = std::variant<
+    std::monostate,
+    char, int8_t, int16_t, int32_t, uint8_t, uint16_t, uint32_t, float, double, std::string,
+    std::vector<char>, std::vector<int8_t>, std::vector<int16_t>, std::vector<int32_t>,
+    std::vector<uint8_t>, std::vector<uint16_t>, std::vector<uint32_t>, std::vector<float>, std::vector<double>
+  >;
+
   /**
    * TODO
    */
@@ -45,7 +62,24 @@ namespace pprzlink {
      * Default constructor of FieldValue.
      * The constructed FieldValue is not usable (used only for adding easily in containers)
      */
-    FieldValue() : field("","char") {}
+    FieldValue() : field(placeholderField()) {}
+
+    /**
+     * Builds a FieldValue for field with no value set yet.
+     * The value keeps its own copy of field.
+     * @param field The MessageField for which the value is built
+     */
+    explicit FieldValue(const MessageField &field) : field(ownField(field)) {}
+
+    /**
+     * Builds a FieldValue for a field of a shared definition with no value set yet, encoded and decoded with the
+     * codec compiled by the definition (see MessageCodec::getFieldCodec).
+     * @param field The MessageField for which the value is built, sharing the ownership of its definition (aliasing
+     * shared_ptr), so that neither the field nor the codec is copied
+     * @param codec The codec of field, owned by the same definition
+     */
+    FieldValue(std::shared_ptr<const MessageField> field, const FieldCodec &codec)
+      : field(std::move(field)), codec(&codec) {}
 
     /**
      * TODO
@@ -58,25 +92,13 @@ namespace pprzlink {
       typename T,
       typename = typename std::enable_if<std::is_arithmetic<T>::value>::type
     >
-    FieldValue(const MessageField &field, const T *array, size_t size) : field(field)
+    FieldValue(const MessageField &field, const T *array, size_t size) : field(ownField(field))
     {
       const auto &type = field.getType();
       if (type.isArray())
       {
-        if (type.getArraySize() && type.getArraySize() != size)
-        {
-          std::stringstream sstr;
-          sstr << "Wrong size in building value for " << field.getName() << ", got " << size << " / expected "
-               << type.getArraySize();
-          throw std::logic_error(sstr.str());
-        }
-        std::vector <std::any> vec;
-        vec.resize(size);
-        for (size_t i = 0; i < size; ++i)
-        {
-          vec[i] = MakeStdAny(field, array[i]);
-        }
-        value = std::any(vec);
+        checkArraySize(field, size);
+        value = makeArrayStorage(field, array, array + size);
       }
       else
       {
@@ -96,36 +118,8 @@ namespace pprzlink {
       typename T,
       typename = typename std::enable_if<std::is_same<std::string, T>::value>::type
     >
-    FieldValue(const MessageField &field, const T &str) : field(field)
+    FieldValue(const MessageField &field, const T &str) : field(ownField(field)), value(makeStorage(field, str))
     {
-      const auto &type = field.getType();
-      const auto &name = field.getName();
-      if (type.getBaseType() != BaseType::STRING && !(type.isArray() && type.getBaseType() == BaseType::CHAR))
-      {
-        throw std::logic_error("Cannot build field " + name + " of type " + type.toString() + " from string value.");
-      }
-      if (type.getBaseType() == BaseType::STRING)
-      {
-        value = std::any(std::string(str));
-      }
-      else
-      {
-        // If it is a char array, treat this as any other array
-        std::vector<std::any> v;
-        if (type.getArraySize() && type.getArraySize() != str.size())
-        {
-          std::stringstream sstr;
-          sstr << "Wrong size in building value for " << field.getName() << ", got " << str.size() << " / expected "
-               << type.getArraySize();
-          throw std::logic_error(sstr.str());
-        }
-        v.reserve(str.size());
-        for (auto val: str)
-        {
-          v.push_back(MakeStdAny(field, val));
-        }
-        value = std::any(v);
-      }
     }
 
 
@@ -156,23 +150,8 @@ namespace pprzlink {
       typename = typename std::enable_if<
         !std::is_arithmetic<Container>::value && !std::is_same<std::string, Container>::value>::type
     >
-    FieldValue(const MessageField &field, const Container &c) : field(field)
+    FieldValue(const MessageField &field, const Container &c) : field(ownField(field)), value(makeStorage(field, c))
     {
-      std::vector <std::any> v;
-      const auto &type = field.getType();
-      if (type.getArraySize() && type.getArraySize() != c.size())
-      {
-        std::stringstream sstr;
-        sstr << "Wrong size in building value for " << field.getName() << ", got " << c.size() << " / expected "
-             << type.getArraySize();
-        throw std::logic_error(sstr.str());
-      }
-      v.reserve(c.size());
-      for (auto val: c)
-      {
-        v.push_back(MakeStdAny(field, val));
-      }
-      value = std::any(v);
     };
 
     /**
@@ -185,9 +164,20 @@ namespace pprzlink {
       typename T,
       typename = typename std::enable_if<std::is_arithmetic<T>::value>::type
     >
-    FieldValue(const MessageField &field, T v) : field(field)
+    FieldValue(const MessageField &field, T v) : field(ownField(field)), value(makeStorage(field, v))
+    {
+    }
+
+    /**
+     * Replace the value while keeping the field.
+     * Accepts the same value types as the constructors.
+     * @tparam ValueType
+     * @param v
+     */
+    template<typename ValueType>
+    void setValue(const ValueType &v)
     {
-      value = MakeStdAny(field, v);
+      value = makeStorage(*field, v);
     }
 
     /**
@@ -201,10 +191,14 @@ namespace pprzlink {
       size_t Size>
     void getValue(std::array <T, Size> &c) const
     {
-      auto vec = std::any_cast < std::vector < std::any >> (value);
+      const auto &vec = std::get<std::vector<T>>(value);
+      if (vec.size() < c.size())
+      {
+        throw std::out_of_range("Field " + getName() + " has less elements than requested");
+      }
       for (size_t i = 0; i < c.size(); ++i)
       {
-        c[i] = std::any_cast<T>(vec[i]);
+        c[i] = vec[i];
       }
     }
 
@@ -222,11 +216,11 @@ namespace pprzlink {
     >
     void getValue(Container &c) const
     {
+      const auto &vec = std::get<std::vector<T>>(value);
       c.clear();
-      auto vec = std::any_cast < std::vector < std::any >> (value);
       for (auto val: vec)
       {
-        c.push_back(std::any_cast<T>(val));
+        c.push_back(val);
       }
     }
 
@@ -242,7 +236,7 @@ namespace pprzlink {
     >
     void getValue(T &val) const
     {
-      val = std::any_cast<T>(value);
+      val = std::get<T>(value);
     }
 
     /**
@@ -256,7 +250,7 @@ namespace pprzlink {
       typename = typename T::value_type>
     void getValue(T &val) const
     {
-      val = std::any_cast<T>(value);
+      val = std::get<T>(value);
     }
 
     /**
@@ -281,7 +275,13 @@ namespace pprzlink {
      * TODO
      * @return
      */
-    [[nodiscard]] const std::any &getValue() const;
+    [[nodiscard]] const FieldStorage &getValue() const;
+
+    /**
+     *
+     * @return true if a value has been set
+     */
+    [[nodiscard]] bool hasValue() const;
 
     /**
      * TODO
@@ -302,6 +302,32 @@ namespace pprzlink {
      */
     size_t addToBuffer(BytesBuffer &buffer) const;
 
+    /**
+     * Decode the value of the field from its binary (little endian) representation.
+     *
+     * @param data start of the binary buffer
+     * @param length length of the binary buffer
+     * @param offset offset of the value in data, updated to point after the value
+     */
+    void readFromBuffer(const uint8_t *data, size_t length, size_t &offset);
+
+    /**
+     * Parse the value of the field from its text representation (as on the Ivy bus): a number, comma separated
+     * numbers for arrays, or a string possibly between double quotes.
+     *
+     * @param text
+     */
+    void readFromText(std::string_view text);
+
+    /**
+     * Append the text representation of the value (as on the Ivy bus) at the end of out: int8 as numbers, floating
+     * point numbers with 6 decimals, arrays comma separated and char arrays between double quotes.
+     * This is the same text as operator<< with OutputInt8AsInt, without going through a stream.
+     *
+     * @param out
+     */
+    void appendText(std::string &out) const;
+
     /**
      *
      * @return the size of the field in bytes if stored in binary
@@ -309,51 +335,183 @@ namespace pprzlink {
     size_t getByteSize() const;
 
   private:
-    MessageField field;
-    std::any value;
+    friend class MessageCodec;
+
+    static const std::shared_ptr<const MessageField> &placeholderField();
+
+    static std::shared_ptr<const MessageField> ownField(const MessageField &field);
+
+    std::shared_ptr<const MessageField> field; // Points into the definition of the message, or to a copy
+    const FieldCodec *codec = nullptr; // Owned by the definition, built on each use when the value has none
+    FieldStorage value;
     bool output_int8_as_int=false;
 
     /**
-     * TODO
+     * Parse a number or a comma separated array of numbers into the storage.
+     * @tparam T C++ type of the base type of the field
+     * @param text
+     */
+    template<typename T>
+    void readNumbersFromText(std::string_view text);
+
+    static void checkArraySize(const MessageField &field, size_t size)
+    {
+      const auto &type = field.getType();
+      if (type.getArraySize() && type.getArraySize() != size)
+      {
+        std::stringstream sstr;
+        sstr << "Wrong size in building value for " << field.getName() << ", got " << size << " / expected "
+             << type.getArraySize();
+        throw std::logic_error(sstr.str());
+      }
+    }
+
+    template<typename Elem, typename Iter>
+    static std::vector<Elem> convertRange(Iter first, Iter last)
+    {
+      std::vector<Elem> vec;
+      vec.reserve(std::distance(first, last));
+      for (; first != last; ++first)
+      {
+        vec.push_back(static_cast<Elem>(*first));
+      }
+      return vec;
+    }
+
+    /**
+     * Builds the storage of an array field from a range of values, converting them to the field base type.
+     * @tparam Iter
+     * @param field
+     * @param first
+     * @param last
+     * @return
+     */
+    template<typename Iter>
+    static FieldStorage makeArrayStorage(const MessageField &field, Iter first, Iter last)
+    {
+      auto &type = field.getType();
+      auto &name = field.getName();
+      switch (type.getBaseType())
+      {
+        case BaseType::NOT_A_TYPE:
+          throw std::logic_error("Field " + name + " as type NOT_A_TYPE");
+        case BaseType::CHAR:
+          return convertRange<char>(first, last);
+        case BaseType::INT8:
+          return convertRange<int8_t>(first, last);
+        case BaseType::INT16:
+          return convertRange<int16_t>(first, last);
+        case BaseType::INT32:
+          return convertRange<int32_t>(first, last);
+        case BaseType::UINT8:
+          return convertRange<uint8_t>(first, last);
+        case BaseType::UINT16:
+          return convertRange<uint16_t>(first, last);
+        case BaseType::UINT32:
+          return convertRange<uint32_t>(first, last);
+        case BaseType::FLOAT:
+          return convertRange<float>(first, last);
+        case BaseType::DOUBLE:
+          return convertRange<double>(first, last);
+        case BaseType::STRING:
+          throw std::logic_error("Arrays of string are not supported for field " + name);
+      }
+      return FieldStorage();
+    }
+
+    /**
+     * Builds the storage of a scalar field, converting the value to the field base type.
      * @tparam ValueType
      * @param field
      * @param value
      * @return
      */
-    template<typename ValueType>
-    static std::any MakeStdAny(const MessageField &field, const ValueType &value)
+    template<
+      typename ValueType,
+      typename = typename std::enable_if<std::is_arithmetic<ValueType>::value>::type
+    >
+    static FieldStorage makeStorage(const MessageField &field, ValueType value)
     {
       auto &type = field.getType();
       auto &name = field.getName();
+      if (type.isArray())
+      {
+        throw std::logic_error("Cannot build array field " + name + " from a scalar");
+      }
       switch (type.getBaseType())
       {
         case BaseType::NOT_A_TYPE:
           throw std::logic_error("Field " + name + " as type NOT_A_TYPE");
-          break;
         case BaseType::CHAR:
-          return std::any(static_cast<char>(value));
+          return static_cast<char>(value);
         case BaseType::INT8:
-          return std::any(static_cast<int8_t>(value));
+          return static_cast<int8_t>(value);
         case BaseType::INT16:
-          return std::any(static_cast<int16_t>(value));
+          return static_cast<int16_t>(value);
         case BaseType::INT32:
-          return std::any(static_cast<int32_t>(value));
+          return static_cast<int32_t>(value);
         case BaseType::UINT8:
-          return std::any(static_cast<uint8_t>(value));
+          return static_cast<uint8_t>(value);
         case BaseType::UINT16:
-          return std::any(static_cast<uint16_t>(value));
+          return static_cast<uint16_t>(value);
         case BaseType::UINT32:
-          return std::any(static_cast<uint32_t>(value));
+          return static_cast<uint32_t>(value);
         case BaseType::FLOAT:
-          return std::any(static_cast<float>(value));
+          return static_cast<float>(value);
         case BaseType::DOUBLE:
-          return std::any(static_cast<double>(value));
+          return static_cast<double>(value);
         case BaseType::STRING:
+        {
           std::stringstream sstr;
           sstr << value;
-          return std::any(sstr.str());
+          return sstr.str();
+        }
+      }
+      return FieldStorage();
+    }
+
+    /**
+     * Builds the storage of a string or char array field.
+     * @param field
+     * @param str
+     * @return
+     */
+    static FieldStorage makeStorage(const MessageField &field, const std::string &str)
+    {
+      const auto &type = field.getType();
+      const auto &name = field.getName();
+      if (type.getBaseType() == BaseType::STRING)
+      {
+        return str;
+      }
+      if (!(type.isArray() && type.getBaseType() == BaseType::CHAR))
+      {
+        throw std::logic_error("Cannot build field " + name + " of type " + type.toString() + " from string value.");
+      }
+      // If it is a char array, treat this as any other array
+      checkArraySize(field, str.size());
+      return std::vector<char>(str.begin(), str.end());
+    }
+
+    static FieldStorage makeStorage(const MessageField &field, const char *s)
+    {
+      return makeStorage(field, std::string(s));
+    }
+
+    template<
+      typename Container,
+      typename T = typename Container::value_type,
+      typename = typename std::enable_if<
+        !std::is_arithmetic<Container>::value && !std::is_same<std::string, Container>::value>::type
+    >
+    static FieldStorage makeStorage(const MessageField &field, const Container &c)
+    {
+      if (!field.getType().isArray())
+      {
+        throw std::logic_error("Cannot build scalar field from an array");
       }
-      return std::any();
+      checkArraySize(field, c.size());
+      return makeArrayStorage(field, c.begin(), c.end());
     }
   };
 }
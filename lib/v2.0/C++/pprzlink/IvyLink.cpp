@@ -27,12 +27,66 @@
 #include <pprzlink/exceptions/pprzlink_exception.h>
 #include <ivy-c++/IvyApplication.h>
 #include <iostream>
-#include <regex>
+#include <string_view>
+#include <charconv>
+#include <algorithm>
 
 namespace pprzlink {
 
-  IvyLink::IvyLink(MessageDictionary const & dict , std::string appName, std::string domain, bool threadedIvy)
-  : dictionary (dict), domain(domain), appName(appName), threaded(threadedIvy), requestNb(0)
+  namespace {
+    /**
+     * Split the fields of a message on spaces, quoted strings (which may contain spaces) are kept whole.
+     *
+     * @param text
+     * @param fields the fields are appended to it, they point into text
+     */
+    void tokenizeFields(std::string_view text, std::vector<std::string_view> &fields)
+    {
+      size_t pos = 0;
+      while (true)
+      {
+        while (pos < text.size() && text[pos] == ' ')
+        {
+          ++pos;
+        }
+        if (pos >= text.size())
+        {
+          break;
+        }
+        size_t end;
+        if (text[pos] == '"')
+        {
+          end = text.find('"', pos + 1);
+          end = (end == std::string_view::npos) ? text.size() : end + 1;
+        }
+        else
+        {
+          end = std::min(text.find(' ', pos), text.size());
+        }
+        fields.push_back(text.substr(pos, end - pos));
+        pos = end;
+      }
+    }
+
+    /**
+     * Remove the quotes around a string if needed.
+     */
+    std::string unquote(std::string_view text)
+    {
+      if (text.size() >= 2 && text.front() == '"' && text.back() == '"')
+      {
+        text = text.substr(1, text.size() - 2);
+      }
+      return std::string(text);
+    }
+  }
+
+  IvyLink::IvyLink(MessageDictionary const & dict , std::string appName, std::string domain, bool threadedIvy,
+                   bool sharedBinding)
+  : dictionary (dict), domain(domain), appName(appName), threaded(threadedIvy), requestNb(0),
+    sharedBinding(sharedBinding), sharedCallback(nullptr), stopRequestTimer(false), requestTimerDestroyed(nullptr),
+    requestTimerId(nullptr), nextLocalBindId(-1),
+    dispatchDepth(0), unboundDuringDispatch(false)
   {
     bus = new Ivy(appName.c_str(), (appName + " ready").c_str(), this, threadedIvy);
     bus->start(domain.c_str());
@@ -40,6 +94,29 @@ namespace pprzlink {
 
   IvyLink::~IvyLink()
   {
+    {
+      std::lock_guard<std::mutex> lock(requestsMutex);
+      stopRequestTimer = true;
+    }
+    requestsChanged.notify_one();
+    if (requestTimer.joinable())
+    {
+      if (requestTimer.get_id() == std::this_thread::get_id())
+      {
+        // Destroyed by a timeout callback, the thread stops once it returns
+        *requestTimerDestroyed = true;
+        requestTimer.detach();
+      }
+      else
+      {
+        requestTimer.join();
+      }
+    }
+    if (requestTimerId != nullptr)
+    {
+      IvyC::TimerRemove(requestTimerId);
+    }
+
     bus->stop();
     if (threaded)
     {
@@ -51,6 +128,19 @@ namespace pprzlink {
     {
       delete (bus);
     }
+    delete (sharedCallback);
+    for (auto &binding : busBindings)
+    {
+      delete (binding.second.callback);
+    }
+    for (auto *callback : retiredCallbacks)
+    {
+      delete (callback);
+    }
+    for (auto &binding : answerBindings)
+    {
+      delete (binding.second.callback);
+    }
   }
 
   void IvyLink::OnApplicationConnected(IvyApplication *app)
@@ -70,38 +160,27 @@ namespace pprzlink {
 
   long IvyLink::BindMessage(const MessageDefinition &def, messageCallback_t cb)
   {
-    auto mcb = new MessageCallback(dictionary, cb);
-    auto regexp = regexpForMessageDefinition(def);
-    //std::cout << "Binding to " << regexp << std::endl;
-    auto id = bus->BindMsg(regexp.c_str(), mcb);
-    messagesCallbackMap[id] = mcb;
-    return id;
+    if (sharedBinding)
+    {
+      return addLocalBinding(bindingsByName, def.getName(), std::move(cb));
+    }
+    return subscribe(regexpForMessageDefinition(def), false, std::move(cb));
   }
 
   long IvyLink::BindOnSrcAc(std::string ac_id, messageCallback_t cb)
   {
-  auto mcb = new AircraftCallback(dictionary, cb);
+    if (sharedBinding)
+    {
+      return addLocalBinding(bindingsBySender, ac_id, std::move(cb));
+    }
     std::stringstream regexp;
     regexp << "^(" << ac_id << ") " << "([^ ]*)( .*)?$";
-    //std::cout << "Binding to " << regexp.str() << std::endl;
-    auto id = bus->BindMsg(regexp.str().c_str(), mcb);
-    aircraftCallbackMap[id] = mcb;
-    return id;
+    return subscribe(regexp.str(), true, std::move(cb));
   }
 
   void IvyLink::UnbindMessage(long bindId)
   {
-    if (messagesCallbackMap.find(bindId) != messagesCallbackMap.end()) {
-      bus->UnbindMsg(bindId);
-      delete (messagesCallbackMap[bindId]);
-      messagesCallbackMap.erase(bindId);
-      return;
-    }
-
-    if (aircraftCallbackMap.find(bindId) != aircraftCallbackMap.end()) {
-      bus->UnbindMsg(bindId);
-      delete (aircraftCallbackMap[bindId]);
-      aircraftCallbackMap.erase(bindId);
+    if (bindId < 0 && (removeLocalBinding(bindId) || cancelRequest(bindId))) {
       return;
     }
 
@@ -113,6 +192,213 @@ namespace pprzlink {
     }
   }
 
+  long IvyLink::addLocalBinding(std::unordered_map<std::string, LocalBindings> &table, const std::string &key,
+                                messageCallback_t cb)
+  {
+    std::lock_guard<std::recursive_mutex> lock(localBindingsMutex);
+    if (sharedCallback == nullptr)
+    {
+      sharedCallback = new IvyMessageCallbackOf<IvyLink>(this, &IvyLink::dispatchMessage);
+      bus->BindMsg("^([^ ]+) ([^ ]+)( .*)?$", sharedCallback);
+    }
+    long id = nextLocalBindId--;
+    table[key].push_back(std::make_unique<LocalBinding>(LocalBinding{id, std::move(cb), false}));
+    return id;
+  }
+
+  long IvyLink::subscribe(const std::string &regexp, bool aircraft, messageCallback_t cb)
+  {
+    std::lock_guard<std::recursive_mutex> lock(localBindingsMutex);
+    auto [iter, added] = bindingsByRegexp.try_emplace(regexp);
+    if (added)
+    {
+      // Looked up on each message, the last subscriber may leave while the bus thread is parsing it
+      auto fanOutCb = [this, regexp](const std::string &sender, const Message &msg) {
+        std::lock_guard<std::recursive_mutex> lock(localBindingsMutex);
+        auto subscribers = bindingsByRegexp.find(regexp);
+        if (subscribers != bindingsByRegexp.end())
+        {
+          fanOut({&subscribers->second}, sender, msg);
+        }
+      };
+      IvyMessageCallback *callback;
+      if (aircraft)
+      {
+        callback = new AircraftCallback(dictionary, fanOutCb);
+      }
+      else
+      {
+        callback = new MessageCallback(dictionary, fanOutCb);
+      }
+      //std::cout << "Binding to " << regexp << std::endl;
+      busBindings[regexp] = BusBinding{bus->BindMsg(regexp.c_str(), callback), callback};
+    }
+    long id = nextLocalBindId--;
+    iter->second.push_back(std::make_unique<LocalBinding>(LocalBinding{id, std::move(cb), false}));
+    return id;
+  }
+
+  void IvyLink::releaseBusBinding(const std::string &regexp)
+  {
+    auto iter = busBindings.find(regexp);
+    if (iter == busBindings.end())
+    {
+      return;
+    }
+    bus->UnbindMsg(iter->second.id);
+    // The callback may be running, from the callback itself or from the Ivy thread, it is deleted with the link
+    retiredCallbacks.push_back(iter->second.callback);
+    busBindings.erase(iter);
+  }
+
+  std::unordered_map<std::string, IvyLink::LocalBindings>::iterator
+  IvyLink::eraseBindings(std::unordered_map<std::string, LocalBindings> &table,
+                         std::unordered_map<std::string, LocalBindings>::iterator iter)
+  {
+    if (&table == &bindingsByRegexp)
+    {
+      releaseBusBinding(iter->first);
+    }
+    return table.erase(iter);
+  }
+
+  bool IvyLink::removeLocalBinding(long bindId)
+  {
+    std::lock_guard<std::recursive_mutex> lock(localBindingsMutex);
+    for (auto *table : {&bindingsByName, &bindingsBySender, &bindingsByRegexp})
+    {
+      for (auto iter = table->begin(); iter != table->end(); ++iter)
+      {
+        auto &bindings = iter->second;
+        auto binding = std::find_if(bindings.begin(), bindings.end(), [bindId](const auto &b) {
+          return b->id == bindId && !b->unbound;
+        });
+        if (binding == bindings.end())
+        {
+          continue;
+        }
+        if (dispatchDepth > 0)
+        {
+          // The callback may be running, it is removed once the dispatch is over
+          (*binding)->unbound = true;
+          unboundDuringDispatch = true;
+        }
+        else
+        {
+          bindings.erase(binding);
+          if (bindings.empty())
+          {
+            eraseBindings(*table, iter);
+          }
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void IvyLink::purgeLocalBindings()
+  {
+    for (auto *table : {&bindingsByName, &bindingsBySender, &bindingsByRegexp})
+    {
+      for (auto iter = table->begin(); iter != table->end();)
+      {
+        auto &bindings = iter->second;
+        bindings.erase(std::remove_if(bindings.begin(), bindings.end(), [](const auto &b) { return b->unbound; }),
+                       bindings.end());
+        iter = bindings.empty() ? eraseBindings(*table, iter) : std::next(iter);
+      }
+    }
+    unboundDuringDispatch = false;
+  }
+
+  void IvyLink::dispatchMessage(IvyApplication *app, int argc, const char **argv)
+  {
+    (void)app;
+    if (argc < 2)
+    {
+      return;
+    }
+    std::lock_guard<std::recursive_mutex> lock(localBindingsMutex);
+
+    // Elements of an unordered_map do not move when it grows, so these stay valid even if a callback binds
+    dispatchKey.assign(argv[1]);
+    auto byName = bindingsByName.find(dispatchKey);
+    LocalBindings *nameBindings = (byName != bindingsByName.end()) ? &byName->second : nullptr;
+    std::string sender = unquote(argv[0]);
+    auto bySender = bindingsBySender.find(sender);
+    LocalBindings *senderBindings = (bySender != bindingsBySender.end()) ? &bySender->second : nullptr;
+    if (nameBindings == nullptr && senderBindings == nullptr)
+    {
+      return;
+    }
+
+    const auto *def = dictionary.tryGetDefinition(argv[1]);
+    if (def == nullptr)
+    {
+      return;
+    }
+    dispatchFields.clear();
+    if (argc >= 3)
+    {
+      tokenizeFields(argv[2], dispatchFields);
+    }
+    if (dispatchFields.size() != def->getNbFields())
+    {
+      return;
+    }
+    Message msg(*def);
+    try
+    {
+      for (size_t i = 0; i < dispatchFields.size(); ++i)
+      {
+        msg.addFieldFromText(i, dispatchFields[i]);
+      }
+    }
+    catch (wrong_message_format &)
+    {
+      return;
+    }
+    msg.setSenderId(sender);
+
+    fanOut({nameBindings, senderBindings}, sender, msg);
+  }
+
+  void IvyLink::fanOut(std::initializer_list<LocalBindings *> bindingsLists, const std::string &sender,
+                       const Message &msg)
+  {
+    std::lock_guard<std::recursive_mutex> lock(localBindingsMutex);
+    dispatchDepth++;
+    try
+    {
+      for (auto *bindings : bindingsLists)
+      {
+        // Bindings added by the callbacks are only called from the next message on
+        const size_t count = (bindings != nullptr) ? bindings->size() : 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+          LocalBinding *binding = (*bindings)[i].get();
+          if (!binding->unbound)
+          {
+            binding->cb(sender, msg);
+          }
+        }
+      }
+    }
+    catch (...)
+    {
+      if (--dispatchDepth == 0 && unboundDuringDispatch)
+      {
+        purgeLocalBindings();
+      }
+      throw;
+    }
+    if (--dispatchDepth == 0 && unboundDuringDispatch)
+    {
+      purgeLocalBindings();
+    }
+  }
+
   std::string IvyLink::messageRegexp(const MessageDefinition &def)
   {
     static const std::map<BaseType, std::string> typeRegex = {
@@ -180,32 +466,27 @@ namespace pprzlink {
     return sstr.str();
   }
 
-  void IvyLink::getMessageData(const Message& msg, std::string &ac_id, std::string &name, std::string &fields) {
-    std::stringstream fieldsStream;
+  void IvyLink::appendSenderId(const Message& msg, std::string &out) {
     if (msg.getSenderId().index()==0) // The variant holds a string
     {
-      ac_id = std::get<std::string>(msg.getSenderId());
+      out += std::get<std::string>(msg.getSenderId());
     }
     else
     {
-      std::stringstream sstr;
-      sstr << (int)std::get<uint8_t>(msg.getSenderId());
-      ac_id = sstr.str();
+      char digits[4];
+      auto result = std::to_chars(digits, digits + sizeof(digits), std::get<uint8_t>(msg.getSenderId()));
+      out.append(digits, result.ptr);
     }
-    const auto &def=msg.getDefinition();
+  }
 
+  void IvyLink::appendMessageText(const Message& msg, std::string &out) {
+    const auto &def=msg.getDefinition();
+    out += def.getName();
     for (size_t i=0;i<def.getNbFields();++i)
     {
-      if (i!=0)
-        fieldsStream << " ";
-      auto val= msg.getRawValue(i);
-      val.setOutputInt8AsInt(true);
-      fieldsStream << val;
+      out.push_back(' ');
+      msg.getRawValue(i).appendText(out);
     }
-
-    name = def.getName();
-    fields = fieldsStream.str();
-
   }
 
   void IvyLink::sendMessage(const Message& msg)
@@ -215,20 +496,20 @@ namespace pprzlink {
       throw message_is_request("Message " + def.getName() + " is a request message. Use sendRequest instead!");
     }
 
-    std::string ac_id;
-    std::string name;
-    std::string fields;
-
-    getMessageData(msg, ac_id, name, fields);
-
-
-    bus->SendMsg("%s %s %s",ac_id.c_str(), def.getName().c_str(), fields.c_str());
+    // Reused by all the messages sent from this thread
+    thread_local std::string text;
+    text.clear();
+    appendSenderId(msg, text);
+    text.push_back(' ');
+    appendMessageText(msg, text);
 
+    bus->SendRawMsg(text.c_str());
   }
 
 
 
-  long IvyLink::sendRequest(const Message& msg, messageCallback_t cb) {
+  long IvyLink::sendRequest(const Message& msg, messageCallback_t cb, std::chrono::milliseconds timeout,
+                            requestTimeoutCallback_t timeoutCb) {
     const auto &def=msg.getDefinition();
 
     if(!def.isRequest()) {
@@ -236,47 +517,204 @@ namespace pprzlink {
     }
 
     // remove last 4 characters (_REQ) from request name to get the answer message name
-    auto ansName = def.getName().substr(0, def.getName().size() - 4);
-    auto ansDef = dictionary.getDefinition(ansName);
-
-    std::string ac_id;
-    std::string name;
-    std::string fields;
+    auto ansName = std::string_view(def.getName()).substr(0, def.getName().size() - 4);
+    const auto &ansDef = dictionary.getDefinition(ansName);
 
-    getMessageData(msg, ac_id, name, fields);
+    long id;
+    {
+      std::lock_guard<std::recursive_mutex> lock(localBindingsMutex);
+      id = nextLocalBindId--;
+    }
 
-    std::stringstream requestIdStream;
-    requestIdStream << getpid() << "_" << requestNb++;
-    std::string requestId = requestIdStream.str();
+    std::string requestId;
+    {
+      std::lock_guard<std::mutex> lock(requestsMutex);
+      if (answerBindings.find(ansDef.getName()) == answerBindings.end())
+      {
+        // Only answers to the requests of this process are sent to us
+        auto callback = new AnswerCallback(dictionary, [this](const std::string &requestId, const std::string &ac_id,
+                                                              const Message &answer) {
+          onAnswer(requestId, ac_id, answer);
+        });
+        std::stringstream regexpStream;
+        regexpStream << "^(" << getpid() << "_[0-9]+) ([^ ]*) " << messageRegexp(ansDef);
+        answerBindings[ansDef.getName()] = BusBinding{bus->BindMsg(regexpStream.str().c_str(), callback), callback};
+      }
 
+      requestId = std::to_string(getpid()) + "_" + std::to_string(requestNb++);
+      auto deadline = requestDeadlines.emplace(std::chrono::steady_clock::now() + timeout, requestId);
+      pendingRequests.emplace(requestId, PendingRequest{id, std::move(cb), std::move(timeoutCb), deadline});
+      requestsByBindId.emplace(id, requestId);
+      if (threaded)
+      {
+        if (!requestTimer.joinable())
+        {
+          requestTimer = std::thread(&IvyLink::runRequestTimer, this);
+        }
+      }
+      else
+      {
+        // The Ivy main loop is not thread safe, its timer is armed from its thread as any other use of the bus
+        armRequestTimer();
+      }
+    }
+    requestsChanged.notify_one();
 
+    std::string text;
+    appendSenderId(msg, text);
+    text.push_back(' ');
+    text += requestId;
+    text.push_back(' ');
+    appendMessageText(msg, text);
+    bus->SendRawMsg(text.c_str());
 
-    auto mcb = new MessageCallback(dictionary, [=](std::string ac_id,Message msg) {
-      cb(std::move(ac_id), std::move(msg));
+    return id;
+  }
 
-      // find bind id, then unbind answer message
-      auto iter = requestBindId.left.find(requestId);
-      if (iter != requestBindId.left.end())
+  void IvyLink::onAnswer(const std::string &requestId, const std::string &ac_id, const Message &msg)
+  {
+    messageCallback_t cb;
+    {
+      std::lock_guard<std::mutex> lock(requestsMutex);
+      auto iter = pendingRequests.find(requestId);
+      if (iter != pendingRequests.end())
       {
-        long id = iter->second;
-        UnbindMessage(id);
-        requestBindId.left.erase(requestId);
-
+        cb = std::move(iter->second.cb);
+        requestDeadlines.erase(iter->second.deadline);
+        requestsByBindId.erase(iter->second.id);
+        pendingRequests.erase(iter);
       }
-    });
+    }
+    if (cb)
+    {
+      requestsChanged.notify_one();
+      cb(ac_id, msg);
+    }
+  }
 
-    std::stringstream regexpStream;
-    regexpStream << "^" << requestId << " ([^ ]*) " << messageRegexp(ansDef);
-    auto id = bus->BindMsg(regexpStream.str().c_str(), mcb);
-    messagesCallbackMap[id] = mcb;
-    requestBindId.insert({requestId, id});
-    bus->SendMsg("%s %s %s %s",ac_id.c_str(), requestId.c_str(), def.getName().c_str(), fields.c_str());
+  size_t IvyLink::expireRequests()
+  {
+    std::vector<requestTimeoutCallback_t> timeoutCbs;
+    size_t expired;
+    {
+      std::lock_guard<std::mutex> lock(requestsMutex);
+      expired = takeExpiredRequests(timeoutCbs);
+    }
+    for (auto &timeoutCb : timeoutCbs)
+    {
+      timeoutCb();
+    }
+    return expired;
+  }
 
-    return id;
+  size_t IvyLink::takeExpiredRequests(std::vector<requestTimeoutCallback_t> &timeoutCbs)
+  {
+    size_t expired = 0;
+    const auto now = std::chrono::steady_clock::now();
+    while (!requestDeadlines.empty() && requestDeadlines.begin()->first <= now)
+    {
+      auto iter = pendingRequests.find(requestDeadlines.begin()->second);
+      if (iter->second.timeoutCb)
+      {
+        timeoutCbs.push_back(std::move(iter->second.timeoutCb));
+      }
+      requestsByBindId.erase(iter->second.id);
+      pendingRequests.erase(iter);
+      requestDeadlines.erase(requestDeadlines.begin());
+      expired++;
+    }
+    return expired;
   }
 
+  bool IvyLink::cancelRequest(long bindId)
+  {
+    {
+      std::lock_guard<std::mutex> lock(requestsMutex);
+      auto byBindId = requestsByBindId.find(bindId);
+      if (byBindId == requestsByBindId.end())
+      {
+        return false;
+      }
+      auto iter = pendingRequests.find(byBindId->second);
+      requestDeadlines.erase(iter->second.deadline);
+      pendingRequests.erase(iter);
+      requestsByBindId.erase(byBindId);
+    }
+    requestsChanged.notify_one();
+    return true;
+  }
 
+  void IvyLink::runRequestTimer()
+  {
+    bool destroyed = false;
+    std::unique_lock<std::mutex> lock(requestsMutex);
+    requestTimerDestroyed = &destroyed;
+    while (!stopRequestTimer)
+    {
+      if (requestDeadlines.empty())
+      {
+        requestsChanged.wait(lock);
+        continue;
+      }
+      // Copied, the request may be gone while waiting
+      const auto deadline = requestDeadlines.begin()->first;
+      if (requestsChanged.wait_until(lock, deadline) == std::cv_status::timeout)
+      {
+        std::vector<requestTimeoutCallback_t> timeoutCbs;
+        takeExpiredRequests(timeoutCbs);
+        lock.unlock();
+        for (auto &timeoutCb : timeoutCbs)
+        {
+          timeoutCb();
+        }
+        if (destroyed)
+        {
+          return;
+        }
+        lock.lock();
+      }
+    }
+  }
+
+  void IvyLink::armRequestTimer()
+  {
+    if (requestDeadlines.empty())
+    {
+      // An armed timer fires for nothing
+      return;
+    }
+    using namespace std::chrono;
+    // Rounded up, so that the earliest request has expired when the timer fires
+    const auto delay = duration_cast<milliseconds>(requestDeadlines.begin()->first - steady_clock::now()).count() + 1;
+    if (requestTimerId == nullptr)
+    {
+      requestTimerId = IvyC::TimerRepeatAfter(1, std::max<long>(delay, 1), &IvyLink::onRequestTimer, this);
+    }
+    else
+    {
+      IvyC::TimerModify(requestTimerId, std::max<long>(delay, 1));
+    }
+  }
 
+  void IvyLink::onRequestTimer(IvyC::TimerId id, void *user_data, unsigned long delta)
+  {
+    (void)id;
+    (void)delta;
+    auto *link = static_cast<IvyLink *>(user_data);
+    std::vector<requestTimeoutCallback_t> timeoutCbs;
+    {
+      std::lock_guard<std::mutex> lock(link->requestsMutex);
+      // Ivy removes the timer once this returns, it fires only once
+      link->requestTimerId = nullptr;
+      link->takeExpiredRequests(timeoutCbs);
+      link->armRequestTimer();
+    }
+    // The link is not used anymore, the callbacks may destroy it
+    for (auto &timeoutCb : timeoutCbs)
+    {
+      timeoutCb();
+    }
+  }
 
   long IvyLink::registerRequestAnswerer(const MessageDefinition &def, answererCallback_t cb) {
     if(!def.isRequest()) {
@@ -289,11 +727,12 @@ namespace pprzlink {
     std::stringstream regexpStream;
     regexpStream << "^([^ ]*) ([^ ]*) " << messageRegexp(def);
 
-    auto mcb = new RequestCallback(dictionary, [=](std::string ac_id,Message msg) {
-      auto answerMsg = cb(std::move(ac_id), std::move(msg));
+    auto reqName = def.getName();
+    auto mcb = new RequestCallback(dictionary, [=](const std::string &ac_id, const Message &msg) {
+      auto answerMsg = cb(ac_id, msg);
       //check message name
       if(ansName != answerMsg.getDefinition().getName()) {
-        throw wrong_answer_to_request("Wrong answer " + answerMsg.getDefinition().getName() + " to request " + def.getName());
+        throw wrong_answer_to_request("Wrong answer " + answerMsg.getDefinition().getName() + " to request " + reqName);
       }
       sendMessage(answerMsg);
     });
@@ -315,7 +754,7 @@ namespace pprzlink {
   void MessageCallback::OnMessage(IvyApplication *app, int argc, const char **argv)
   {
     (void)app;
-    MessageDefinition def = dictionary.getDefinition(argv[1]);
+    const auto &def = dictionary.getDefinition(argv[1]);
     Message msg(def);
     if (def.getNbFields() != (size_t)(argc - 2) )
     {
@@ -326,103 +765,10 @@ namespace pprzlink {
     }
     for (int i = 2; i < argc; ++i)
     {
-      const auto& field = def.getField(i - 2);
-      // Need deserializing string to build FieldValue
-
-      // For char arrays and strings remove possible quotes
-      if ((field.getType().getBaseType()==BaseType::STRING || (field.getType().getBaseType()==BaseType::CHAR && field.getType().isArray())) && argv[i][0]=='"')
-      {
-        std::string str(argv[i]);
-        //std::cout << str.substr(1,str.size()-2) << std::endl;
-        msg.addField(field.getName(),str.substr(1,str.size()-2));
-      }
-      else
-      {
-        std::stringstream sstr(argv[i]);
-        if (field.getType().isArray())
-        {
-          switch (field.getType().getBaseType())
-          {
-            case BaseType::NOT_A_TYPE:
-              throw std::logic_error("NOT_A_TYPE for field " + field.getName() + " in message " + argv[1]);
-              break;
-            case BaseType::CHAR:
-              throw wrong_message_format("Wrong field format for a char[] "+std::string(argv[i]));
-              break;
-            case BaseType::INT8:
-            case BaseType::INT16:
-            case BaseType::INT32:
-            case BaseType::UINT8:
-            case BaseType::UINT16:
-            case BaseType::UINT32:
-            case BaseType::FLOAT:
-            case BaseType::DOUBLE:
-            {
-              // Parse all numbers as a double
-              std::vector<double> values;
-              while (!sstr.eof())
-              {
-                double val;
-                char c;
-                sstr >> val >> c;
-                if (c!=',')
-                {
-                  throw wrong_message_format("Wrong format for array "+std::string(argv[i]));
-                }
-                values.push_back(val);
-              }
-              msg.addField(field.getName(), values); // The value will be statically cast to the right type
-            }
-              break;
-            case BaseType::STRING:
-              msg.addField(field.getName(), argv[i]);
-              break;
-          }
-        }
-        else
-        {
-          switch (field.getType().getBaseType())
-          {
-            case BaseType::NOT_A_TYPE:
-              throw std::logic_error("NOT_A_TYPE for field " + field.getName() + " in message " + argv[1]);
-              break;
-            case BaseType::CHAR:
-            {
-              char val;
-              sstr >> val;
-              msg.addField(field.getName(), val);
-            }
-              break;
-            case BaseType::INT8:
-            case BaseType::INT16:
-            case BaseType::INT32:
-            case BaseType::UINT8:
-            case BaseType::UINT16:
-            case BaseType::UINT32:
-            case BaseType::FLOAT:
-            case BaseType::DOUBLE:
-            {
-              // Parse all numbers as a double
-              double val;
-              sstr >> val;
-              msg.addField(field.getName(), val); // The value will be statically cast to the right type
-            }
-              break;
-            case BaseType::STRING:
-              msg.addField(field.getName(), argv[i]);
-              break;
-          }
-        }
-      }
-    }
-    std::string sender(argv[0]);
-    if (argv[0][0]=='"')
-    {
-      // Remove quotes from string if needed
-      sender=sender.substr(1,sender.size()-2);
+      msg.addFieldFromText(i - 2, argv[i]);
     }
 
-    cb(sender, msg);
+    cb(unquote(argv[0]), msg);
   }
 
 
@@ -454,127 +800,46 @@ namespace pprzlink {
   void AircraftCallback::OnMessage(IvyApplication *app, int argc, const char **argv)
   {
     (void)app;
-    MessageDefinition def = dictionary.getDefinition(argv[1]);
+    const auto &def = dictionary.getDefinition(argv[1]);
     Message msg(def);
 
     if (argc==3) // If we have fields to parse
     {
-      std::regex fieldRegex("([^ ]+|\"[^\"]+\")");
-
-      std::smatch results;
-      std::vector<std::string> fields;
-      std::string fieldsStr(argv[2]);
-      while (std::regex_search(fieldsStr, results, fieldRegex))
-      {
-        fields.push_back(results.str());
-        fieldsStr = results.suffix();
-      }
+      fields.clear();
+      tokenizeFields(argv[2], fields);
 
       if (def.getNbFields()!=fields.size()) // check that the number of fields is correct
       {
         throw wrong_message_format("Wrong number of fields in message " + std::string(argv[1]));
       }
 
-      for (size_t i = 0; i < def.getNbFields(); ++i)
+      for (size_t i = 0; i < fields.size(); ++i)
       {
-        const auto &field = def.getField(i);
-
-        // For char arrays and strings remove possible quotes
-        if ((field.getType().getBaseType() == BaseType::STRING ||
-             (field.getType().getBaseType() == BaseType::CHAR && field.getType().isArray())) && argv[i][0] == '"')
-        {
-          std::string &str(fields[i]);
-          //std::cout << str.substr(1,str.size()-2) << std::endl;
-          msg.addField(field.getName(), str.substr(1, str.size() - 2));
-        }
-        else
-        {
-          std::stringstream sstr(fields[i]);
-          if (field.getType().isArray())
-          {
-            switch (field.getType().getBaseType())
-            {
-              case BaseType::NOT_A_TYPE:
-                throw std::logic_error("NOT_A_TYPE for field " + field.getName() + " in message " + argv[1]);
-                break;
-              case BaseType::CHAR:
-                throw wrong_message_format("Wrong field format for a char[] " + fields[i]);
-                break;
-              case BaseType::INT8:
-              case BaseType::INT16:
-              case BaseType::INT32:
-              case BaseType::UINT8:
-              case BaseType::UINT16:
-              case BaseType::UINT32:
-              case BaseType::FLOAT:
-              case BaseType::DOUBLE:
-              {
-                // Parse all numbers as a double
-                std::vector<double> values;
-                while (!sstr.eof())
-                {
-                  double val;
-                  char c;
-                  sstr >> val >> c;
-                  if (c != ',')
-                  {
-                    throw wrong_message_format("Wrong format for array \"" + fields[i] + "\"");
-                  }
-                  values.push_back(val);
-                }
-                msg.addField(field.getName(), values); // The value will be statically cast to the right type
-              }
-                break;
-              case BaseType::STRING:
-                msg.addField(field.getName(), fields[i]);
-                break;
-            }
-          }
-          else
-          {
-            switch (field.getType().getBaseType())
-            {
-              case BaseType::NOT_A_TYPE:
-                throw std::logic_error("NOT_A_TYPE for field " + field.getName() + " in message " + argv[1]);
-                break;
-              case BaseType::CHAR:
-              {
-                char val;
-                sstr >> val;
-                msg.addField(field.getName(), val);
-              }
-                break;
-              case BaseType::INT8:
-              case BaseType::INT16:
-              case BaseType::INT32:
-              case BaseType::UINT8:
-              case BaseType::UINT16:
-              case BaseType::UINT32:
-              case BaseType::FLOAT:
-              case BaseType::DOUBLE:
-              {
-                // Parse all numbers as a double
-                double val;
-                sstr >> val;
-                msg.addField(field.getName(), val); // The value will be statically cast to the right type
-              }
-                break;
-              case BaseType::STRING:
-                msg.addField(field.getName(), fields[i]);
-                break;
-            }
-          }
-        }
+        msg.addFieldFromText(i, fields[i]);
       }
     }
-    std::string sender(argv[0]);
-    if (argv[0][0]=='"')
-    {
-      // Remove quotes from string if needed
-      sender=sender.substr(1,sender.size()-2);
-    }
+    std::string sender = unquote(argv[0]);
     msg.setSenderId(sender);
 
     cb(sender, msg);
   }
+
+  AnswerCallback::AnswerCallback(const MessageDictionary &dictionary, const answerCallback_t &cb)
+    : MessageCallback(dictionary, [this, cb](const std::string &ac_id, const Message &msg) {
+        cb(requestId, ac_id, msg);
+      })
+  {
+  }
+
+  void AnswerCallback::OnMessage(IvyApplication *app, int argc, const char **argv)
+  {
+    if (argc < 3)
+    {
+      throw wrong_message_format("Not enough fields to be a valid answer!");
+    }
+
+    requestId.assign(argv[0]);
+
+    MessageCallback::OnMessage(app, argc - 1, argv + 1);
+  }
 }
@@ -27,18 +27,32 @@
 #define PPRZLINKCPP_IVYLINK_H
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+#include <initializer_list>
 #include <pprzlink/MessageDictionary.h>
 #include <ivy-c++/Ivy.h>
 #include <pprzlink/Message.h>
-#include <boost/bimap.hpp>
+#include <chrono>
+#include <map>
+
+#ifndef IVY_REQUEST_TIMEOUT
+#define IVY_REQUEST_TIMEOUT (5000) // Default time to wait for the answer to a request, in ms
+#endif
 
 namespace pprzlink {
   class MessageCallback;
   class AircraftCallback;
   class RequestCallback;
 
-  using messageCallback_t = std::function<void(std::string,Message)>;
-  using answererCallback_t = std::function<Message(std::string,Message)>;
+  using messageCallback_t = std::function<void(const std::string &, const Message &)>;
+  using answererCallback_t = std::function<Message(const std::string &, const Message &)>;
+  using requestTimeoutCallback_t = std::function<void()>;
 
   /**
    *
@@ -51,8 +65,11 @@ namespace pprzlink {
      * @param appName
      * @param domain
      * @param threadedIvy
+     * @param sharedBinding register a single binding on the bus for all the messages and dispatch them to the
+     * callbacks in process, by message name or sender, instead of one regular expression per binding
      */
-    IvyLink(MessageDictionary const & dict , std::string appName, std::string domain = "127.255.255.255:2010", bool threadedIvy = false);
+    IvyLink(MessageDictionary const & dict , std::string appName, std::string domain = "127.255.255.255:2010",
+            bool threadedIvy = false, bool sharedBinding = false);
 
     /**
      *
@@ -60,16 +77,18 @@ namespace pprzlink {
     ~IvyLink();
 
     /**
+     * Binding several times on the same message shares a single binding on the bus, the message is parsed once and
+     * handed to all the callbacks.
      *
      * @param def
      * @param cb
-     * @return
+     * @return the id to unbind this callback
      */
     long BindMessage(MessageDefinition const & def, messageCallback_t cb);
 
     /**
      * Bind on all messages coming from given ac_id
-     * @param ac_id
+     * @param ac_id regular expression matching the sender, or the exact sender with a shared binding
      * @param cb
      * @return
      */
@@ -88,7 +107,28 @@ namespace pprzlink {
      */
     void sendMessage(const Message& msg);
 
-    long sendRequest(const Message& msg, messageCallback_t cb);
+    /**
+     * Send a request and wait for its answer in the background. The answers are received through a single binding
+     * per answer message, kept for the life of the link, and matched to their request by its id.
+     *
+     * @param msg
+     * @param cb called with the answer
+     * @param timeout time to wait for the answer, the request is forgotten afterwards
+     * @param timeoutCb called if the answer did not come in time (optional), from the Ivy main loop, or from the
+     * request timer thread with threadedIvy
+     * @return the id to cancel the request with UnbindMessage
+     */
+    long sendRequest(const Message& msg, messageCallback_t cb,
+                     std::chrono::milliseconds timeout = std::chrono::milliseconds(IVY_REQUEST_TIMEOUT),
+                     requestTimeoutCallback_t timeoutCb = nullptr);
+
+    /**
+     * Forget the requests whose answer did not come in time and call their timeout callbacks.
+     * The request timer does it at the earliest deadline, calling it is only needed to expire requests earlier.
+     *
+     * @return the number of requests expired
+     */
+    size_t expireRequests();
 
     long registerRequestAnswerer(const MessageDefinition &def, answererCallback_t cb);
 
@@ -99,9 +139,20 @@ namespace pprzlink {
     Ivy *bus;
     bool threaded;
     unsigned int requestNb;
-    boost::bimap<std::string, long> requestBindId;
 
-    void getMessageData(const Message& msg, std::string &ac_id, std::string &name, std::string &fieldStream);
+    /**
+     * Append the sender id of the message at the end of out.
+     * @param msg
+     * @param out
+     */
+    static void appendSenderId(const Message& msg, std::string &out);
+
+    /**
+     * Append the name and the fields of the message at the end of out, separated by spaces.
+     * @param msg
+     * @param out
+     */
+    static void appendMessageText(const Message& msg, std::string &out);
 
     /**
      *
@@ -112,10 +163,171 @@ namespace pprzlink {
 
     std::string messageRegexp(MessageDefinition const & def);
 
-    std::map<long,MessageCallback*> messagesCallbackMap;
-    std::map<long,AircraftCallback*> aircraftCallbackMap;
     std::map<long,RequestCallback*> requestCallbackMap;
 
+    /// Callback of a binding served by the shared binding
+    struct LocalBinding {
+      long id;
+      messageCallback_t cb;
+      bool unbound; // Unbound during a dispatch, removed once it is over
+    };
+    using LocalBindings = std::vector<std::unique_ptr<LocalBinding>>;
+
+    /// Binding on the bus shared by all the subscribers to the same regular expression
+    struct BusBinding {
+      long id;
+      IvyMessageCallback *callback;
+    };
+
+    bool sharedBinding;
+    IvyMessageCallback *sharedCallback; // Registered on the bus with the first binding
+    std::unordered_map<std::string, LocalBindings> bindingsByName;
+    std::unordered_map<std::string, LocalBindings> bindingsBySender;
+    std::unordered_map<std::string, LocalBindings> bindingsByRegexp; // Without a shared binding
+    std::unordered_map<std::string, BusBinding> busBindings; // By regular expression
+    std::vector<IvyMessageCallback *> retiredCallbacks; // Unbound from the bus, deleted once the bus is stopped
+
+    using Deadlines = std::multimap<std::chrono::steady_clock::time_point, std::string>;
+
+    /// Request waiting for its answer
+    struct PendingRequest {
+      long id;
+      messageCallback_t cb;
+      requestTimeoutCallback_t timeoutCb;
+      Deadlines::iterator deadline;
+    };
+
+    std::unordered_map<std::string, PendingRequest> pendingRequests; // By request id
+    std::unordered_map<long, std::string> requestsByBindId; // Request ids by the id returned by sendRequest
+    Deadlines requestDeadlines; // Request ids by deadline
+    std::unordered_map<std::string, BusBinding> answerBindings; // By answer message name
+    std::mutex requestsMutex; // Never held while calling back
+    std::condition_variable requestsChanged; // Wakes the request timer up to wait for the new earliest deadline
+    std::thread requestTimer; // With threadedIvy, started with the first request
+    bool stopRequestTimer;
+    bool *requestTimerDestroyed; // Set by the request timer thread, tells it the link was destroyed by a callback
+    IvyC::TimerId requestTimerId; // Without threadedIvy, Ivy timer of the earliest deadline, nullptr if not armed
+    std::recursive_mutex localBindingsMutex; // Callbacks may bind or unbind
+    long nextLocalBindId; // Negative so as not to collide with the ids of the bus (used by requests)
+    int dispatchDepth;
+    bool unboundDuringDispatch;
+    std::string dispatchKey; // Reused to look up the tables
+    std::vector<std::string_view> dispatchFields; // Reused to split the fields
+
+    /**
+     *
+     * @param table
+     * @param key
+     * @param cb
+     * @return the id of the new binding
+     */
+    long addLocalBinding(std::unordered_map<std::string, LocalBindings> &table, const std::string &key,
+                         messageCallback_t cb);
+
+    /**
+     * Add a subscriber to a regular expression, binding it on the bus for the first one.
+     *
+     * @param regexp
+     * @param aircraft true to parse the messages as BindOnSrcAc does
+     * @param cb
+     * @return the id of the new binding
+     */
+    long subscribe(const std::string &regexp, bool aircraft, messageCallback_t cb);
+
+    /**
+     * Unbind a regular expression from the bus once its last subscriber has left.
+     *
+     * @param regexp
+     */
+    void releaseBusBinding(const std::string &regexp);
+
+    /**
+     *
+     * @param bindId
+     * @return true if bindId was a binding returned by BindMessage or BindOnSrcAc
+     */
+    bool removeLocalBinding(long bindId);
+
+    /**
+     * Remove the entry of a table once its last binding has left.
+     *
+     * @param table
+     * @param iter
+     * @return the next entry
+     */
+    std::unordered_map<std::string, LocalBindings>::iterator
+    eraseBindings(std::unordered_map<std::string, LocalBindings> &table,
+                  std::unordered_map<std::string, LocalBindings>::iterator iter);
+
+    /**
+     * Call the callbacks of a parsed message, the bindings unbound meanwhile are removed once all are called.
+     *
+     * @param bindingsLists
+     * @param sender
+     * @param msg
+     */
+    void fanOut(std::initializer_list<LocalBindings *> bindingsLists, const std::string &sender, const Message &msg);
+
+    /**
+     * Remove the bindings unbound during a dispatch.
+     */
+    void purgeLocalBindings();
+
+    /**
+     * Call the callback of the request an answer belongs to, answers to unknown or expired requests are ignored.
+     *
+     * @param requestId
+     * @param ac_id
+     * @param msg
+     */
+    void onAnswer(const std::string &requestId, const std::string &ac_id, const Message &msg);
+
+    /**
+     *
+     * @param bindId
+     * @return true if bindId was a pending request
+     */
+    bool cancelRequest(long bindId);
+
+    /**
+     * Forget the requests whose answer did not come in time, requestsMutex must be held.
+     *
+     * @param timeoutCbs the timeout callbacks of the expired requests are appended to it
+     * @return the number of requests expired
+     */
+    size_t takeExpiredRequests(std::vector<requestTimeoutCallback_t> &timeoutCbs);
+
+    /**
+     * Body of the request timer thread, with threadedIvy: wait for the earliest deadline and expire the requests,
+     * until the link is destroyed.
+     */
+    void runRequestTimer();
+
+    /**
+     * Without threadedIvy, arm the Ivy timer on the earliest deadline, requestsMutex must be held.
+     */
+    void armRequestTimer();
+
+    /**
+     * Callback of the Ivy timer: expire the requests and arm the timer on the next deadline.
+     *
+     * @param id
+     * @param user_data the link
+     * @param delta
+     */
+    static void onRequestTimer(IvyC::TimerId id, void *user_data, unsigned long delta);
+
+    /**
+     * Callback of the shared binding: parse the message once and call the callbacks bound on its name and sender.
+     * Messages which are not in the dictionary or do not match their definition are ignored, as they would not
+     * have matched a regular expression.
+     *
+     * @param app
+     * @param argc
+     * @param argv sender, message name and fields
+     */
+    void dispatchMessage(IvyApplication *app, int argc, const char **argv);
+
     /**
      *
      * @param app
@@ -195,6 +407,7 @@ namespace pprzlink {
   private:
     const MessageDictionary &dictionary;
     messageCallback_t cb;
+    std::vector<std::string_view> fields; // Reused across messages
   };
 
 
@@ -221,5 +434,32 @@ namespace pprzlink {
     std::string requestId;
   };
 
+  /**
+   * Callback of the answers to requests: the request id comes first, followed by the answer message.
+   */
+  class AnswerCallback : public MessageCallback {
+  public:
+    using answerCallback_t = std::function<void(const std::string &requestId, const std::string &ac_id,
+                                                const Message &msg)>;
+
+    /**
+     *
+     * @param dictionary
+     * @param cb
+     */
+    AnswerCallback(const MessageDictionary &dictionary, const answerCallback_t &cb);
+
+    /**
+     *
+     * @param app
+     * @param argc
+     * @param argv
+     */
+    void OnMessage(IvyApplication *app, int argc, const char **argv) override;
+
+  private:
+    std::string requestId;
+  };
+
 }
 #endif //PPRZLINKCPP_IVYLINK_H
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file LinkReactor.cpp
+ *
+ *
+ */
+
+#include "LinkReactor.h"
+
+namespace pprzlink {
+
+  LinkReactor::Channel::Channel(std::unique_ptr<Device> device, const MessageDictionary &dictionary)
+    : device(std::move(device)), transport(this->device.get(), dictionary)
+  {
+  }
+
+  LinkReactor::LinkReactor(const MessageDictionary &dictionary) : dictionary(dictionary)
+  {
+  }
+
+  LinkReactor::LinkId LinkReactor::addSerialLink(const std::string &portName,
+                                                 const BoostSerialPortDevice::Baudrate &baudrate)
+  {
+    auto device = std::make_unique<BoostSerialPortDevice>(ioService, portName);
+    device->setBaudrate(baudrate);
+    auto *serial = device.get();
+    addChannel(std::move(device)).serial = serial;
+    serial->startReception();
+    return channels.size() - 1;
+  }
+
+  LinkReactor::LinkId LinkReactor::addUdpLink(const std::string &address, unsigned short uplinkPort,
+                                              unsigned short downlinkPort)
+  {
+    auto device = std::make_unique<UdpDevice>(ioService, address, uplinkPort, downlinkPort);
+    auto *udp = device.get();
+    addChannel(std::move(device)).udp = udp;
+    udp->startReception();
+    return channels.size() - 1;
+  }
+
+  LinkReactor::Channel &LinkReactor::addChannel(std::unique_ptr<Device> device)
+  {
+    const LinkId link = channels.size();
+    channels.push_back(std::make_unique<Channel>(std::move(device), dictionary));
+    Channel *added = channels.back().get();
+
+    added->transport.addMessageHandler([this, link, added](const MessageView &view) {
+      added->statistics.messagesReceived++;
+      if (messageHandler)
+      {
+        messageHandler(link, view);
+      }
+    });
+    // Instead of PprzTransport::listen, so as to count the bytes on their way to the transport
+    added->device->setBytesCallback([added](const uint8_t *data, size_t length) {
+      added->statistics.bytesReceived += length;
+      added->transport.onBytes(data, length);
+    });
+    added->device->setErrorCallback([added](const std::exception &, bool receptionStopped) {
+      added->statistics.errors++;
+      added->statistics.closed = added->statistics.closed || receptionStopped;
+    });
+    return *added;
+  }
+
+  void LinkReactor::setMessageHandler(MessageHandler handler)
+  {
+    messageHandler = std::move(handler);
+  }
+
+  size_t LinkReactor::sendMessage(LinkId link, const Message &msg)
+  {
+    Channel &target = channel(link);
+    size_t sent = target.transport.sendMessage(msg);
+    target.statistics.bytesSent += sent;
+    target.statistics.messagesSent++;
+    return sent;
+  }
+
+  void LinkReactor::run()
+  {
+    // The pending receptions keep the io_service busy, it only returns when stopped
+    ioService.restart();
+    ioService.run();
+  }
+
+  size_t LinkReactor::poll()
+  {
+    ioService.restart();
+    return ioService.poll();
+  }
+
+  void LinkReactor::stop()
+  {
+    ioService.stop();
+  }
+
+  size_t LinkReactor::getLinkCount() const
+  {
+    return channels.size();
+  }
+
+  Device &LinkReactor::getDevice(LinkId link)
+  {
+    return *channel(link).device;
+  }
+
+  PprzTransport &LinkReactor::getTransport(LinkId link)
+  {
+    return channel(link).transport;
+  }
+
+  LinkReactor::LinkStatistics LinkReactor::getStatistics(LinkId link) const
+  {
+    const Channel &target = *channels.at(link);
+    LinkStatistics statistics = target.statistics;
+    statistics.checksumErrors = target.transport.getChecksumErrors();
+    statistics.unknownMessages = target.transport.getUnknownMessages();
+    if (target.serial)
+    {
+      statistics.droppedBytes = target.serial->getDroppedBytes();
+      statistics.droppedWriteBytes = target.serial->getDroppedWriteBytes();
+    }
+    if (target.udp)
+    {
+      statistics.truncatedDatagrams = target.udp->getTruncatedDatagrams();
+      statistics.droppedDatagrams = target.udp->getDroppedDatagrams();
+    }
+    return statistics;
+  }
+
+  boost::asio::io_service &LinkReactor::getIoService()
+  {
+    return ioService;
+  }
+
+  LinkReactor::Channel &LinkReactor::channel(LinkId link)
+  {
+    return *channels.at(link);
+  }
+}
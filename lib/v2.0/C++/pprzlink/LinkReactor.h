@@ -0,0 +1,192 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file LinkReactor.h
+ *
+ *
+ */
+
+#ifndef PPRZLINKCPP_LINKREACTOR_H
+#define PPRZLINKCPP_LINKREACTOR_H
+
+#include "BoostSerialPortDevice.h"
+#include "PprzTransport.h"
+#include "UdpDevice.h"
+#include <boost/asio/io_service.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pprzlink {
+  /**
+   * Single event loop serving many links (e.g. one serial or UDP link per aircraft of a swarm).
+   *
+   * All the devices share the io_service of the reactor, which waits for all of them at once (with epoll on linux).
+   * When a device is readable its bytes are decoded at once and the messages are dispatched to the handler, so that
+   * the thread calling run or poll does all the work and no thread nor polling loop is needed per link.
+   *
+   * The errors of a device are recorded in the statistics of its link instead of stopping the event loop, so that a
+   * failing link does not stop the others.
+   *
+   * The reactor is not thread safe: the links must be added, and the messages sent, from the thread running it.
+   */
+  class LinkReactor {
+  public:
+    /// Identifies a link, in the order the links were added
+    using LinkId = size_t;
+
+    /// Called for each message received on any link, the view is only valid during the call
+    using MessageHandler = std::function<void(LinkId link, const MessageView &)>;
+
+    /// Traffic and errors of a link
+    struct LinkStatistics {
+      size_t bytesReceived = 0;
+      size_t messagesReceived = 0;
+      size_t bytesSent = 0;
+      size_t messagesSent = 0;
+      size_t errors = 0; ///< Errors of the device in the io_service
+      bool closed = false; ///< The device stopped receiving because of an error
+      size_t checksumErrors = 0; ///< See PprzTransport::getChecksumErrors
+      size_t unknownMessages = 0; ///< See PprzTransport::getUnknownMessages
+      size_t droppedBytes = 0; ///< Received while the buffer of a serial link was full
+      size_t droppedWriteBytes = 0; ///< Dropped because the write queue of a serial link was full
+      size_t truncatedDatagrams = 0; ///< Too large datagrams of an UDP link
+      size_t droppedDatagrams = 0; ///< Datagrams an UDP link could not send
+    };
+
+    /**
+     *
+     * @param dictionary used to decode the messages of all the links
+     */
+    explicit LinkReactor(const MessageDictionary &dictionary);
+
+    LinkReactor(const LinkReactor &) = delete;
+    LinkReactor &operator=(const LinkReactor &) = delete;
+
+    /**
+     * Open a serial port and receive from it.
+     *
+     * @param portName
+     * @param baudrate
+     * @return the id of the new link
+     */
+    LinkId addSerialLink(const std::string &portName,
+                         const BoostSerialPortDevice::Baudrate &baudrate = BoostSerialPortDevice::Baudrate(57600));
+
+    /**
+     * Open a UDP socket and receive from it.
+     *
+     * @param address address of the remote (may be a broadcast address)
+     * @param uplinkPort
+     * @param downlinkPort
+     * @return the id of the new link
+     */
+    LinkId addUdpLink(const std::string &address, unsigned short uplinkPort = UDP_UPLINK_PORT,
+                      unsigned short downlinkPort = UDP_DOWNLINK_PORT);
+
+    /**
+     * Set the handler called for the messages of all the links.
+     *
+     * @param handler
+     */
+    void setMessageHandler(MessageHandler handler);
+
+    /**
+     * Frame a message and send it on a link.
+     *
+     * @param link
+     * @param msg
+     * @return the number of bytes sent
+     * @throws write_queue_full if the device of the link dropped the frame
+     */
+    size_t sendMessage(LinkId link, const Message &msg);
+
+    /**
+     * Run the event loop until stop is called.
+     */
+    void run();
+
+    /**
+     * Handle the events that are ready without waiting.
+     *
+     * @return the number of handlers run
+     */
+    size_t poll();
+
+    /**
+     * Make run return as soon as possible.
+     */
+    void stop();
+
+    [[nodiscard]] size_t getLinkCount() const;
+
+    /**
+     *
+     * @param link
+     * @return the device of the link, e.g. to read its drop counters
+     */
+    [[nodiscard]] Device &getDevice(LinkId link);
+
+    [[nodiscard]] PprzTransport &getTransport(LinkId link);
+
+    /**
+     *
+     * @param link
+     * @return the statistics of the link, with the current counters of its transport and device
+     */
+    [[nodiscard]] LinkStatistics getStatistics(LinkId link) const;
+
+    [[nodiscard]] boost::asio::io_service &getIoService();
+
+  protected:
+    struct Channel {
+      Channel(std::unique_ptr<Device> device, const MessageDictionary &dictionary);
+
+      std::unique_ptr<Device> device;
+      PprzTransport transport;
+      LinkStatistics statistics; // Counted by the reactor
+      BoostSerialPortDevice *serial = nullptr; // The device, if it is a serial port, to read its counters
+      UdpDevice *udp = nullptr; // Idem for UDP
+    };
+
+    /**
+     * Route the bytes and messages of a new link through the reactor.
+     *
+     * @param device
+     * @return the channel of the link, its device still has to start its reception
+     */
+    Channel &addChannel(std::unique_ptr<Device> device);
+
+    /**
+     *
+     * @param link
+     * @return the channel of the link
+     * @throws std::out_of_range if there is no such link
+     */
+    Channel &channel(LinkId link);
+
+    const MessageDictionary &dictionary;
+    boost::asio::io_service ioService;
+    std::vector<std::unique_ptr<Channel>> channels; // Channels do not move, the callbacks point to them
+    MessageHandler messageHandler;
+  };
+}
+
+#endif //PPRZLINKCPP_LINKREACTOR_H
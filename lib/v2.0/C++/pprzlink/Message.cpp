@@ -25,145 +25,93 @@
 #include <iostream>
 #include <pprzlink/Message.h>
 
-namespace pprzlink {
-
-  Message::Message() : sender_id(static_cast<uint8_t>(0)),receiver_id(static_cast<uint8_t>(0)),component_id(static_cast<uint8_t>(0))
-  {
+namespace {
+  /**
+   * Share the definition if it is already owned by a shared_ptr (e.g. it comes from a MessageDictionary),
+   * otherwise make a shared copy of it.
+   */
+  std::shared_ptr<const pprzlink::MessageDefinition> shareDefinition(const pprzlink::MessageDefinition &def)
+  {
+    auto shared = def.weak_from_this().lock();
+    if (shared)
+    {
+      return shared;
+    }
+    return std::make_shared<const pprzlink::MessageDefinition>(def);
   }
 
-  Message::Message(const MessageDefinition &def) : def(def),sender_id(static_cast<uint8_t>(0)),receiver_id(static_cast<uint8_t>(0)),component_id(static_cast<uint8_t>(0))
+  const std::shared_ptr<const pprzlink::MessageDefinition> &emptyDefinition()
   {
+    static const auto empty = std::make_shared<const pprzlink::MessageDefinition>();
+    return empty;
   }
+}
 
-  size_t Message::getNbValues() const
+namespace pprzlink {
+
+  Message::Message() : def(emptyDefinition()), sender_id(static_cast<uint8_t>(0)),receiver_id(static_cast<uint8_t>(0)),component_id(static_cast<uint8_t>(0))
   {
-    return fieldValues.size();
   }
 
-  const MessageDefinition &Message::getDefinition() const
+  Message::Message(const MessageDefinition &def) : Message(shareDefinition(def))
   {
-    return def;
   }
 
-  template<typename StreamType>
-  void addFieldToStream(StreamType &stream,const MessageField &field,std::any value, bool uint8_as_int=false)
+  Message::Message(std::shared_ptr<const MessageDefinition> def) : def(std::move(def)),sender_id(static_cast<uint8_t>(0)),receiver_id(static_cast<uint8_t>(0)),component_id(static_cast<uint8_t>(0))
   {
-    switch (field.getType().getBaseType())
+    fieldValues.reserve(this->def->getNbFields());
+    const auto &codec = this->def->getCodec();
+    for (size_t i=0;i<this->def->getNbFields();++i)
     {
-      case BaseType::CHAR :
-        stream << std::any_cast<char>(value);
-        break;
-      case BaseType::INT8:
-        if (uint8_as_int)
-        {
-          stream << (int)std::any_cast<int8_t>(value);
-        }
-        else
-        {
-          stream << std::any_cast<int8_t>(value);
-        }
-        break;
-      case BaseType::INT16:
-        stream << std::any_cast<int16_t>(value);
-        break;
-      case BaseType::INT32:
-        stream << std::any_cast<int32_t>(value);
-        break;
-      case BaseType::UINT8:
-        if (uint8_as_int)
-        {
-          stream << (int)std::any_cast<uint8_t>(value);
-        }
-        else
-        {
-          stream << std::any_cast<uint8_t>(value);
-        }
-        break;
-      case BaseType::UINT16:
-        stream << std::any_cast<uint16_t>(value);
-        break;
-      case BaseType::UINT32:
-        stream << std::any_cast<uint32_t>(value);
-        break;
-      case BaseType::FLOAT:
-        stream << std::any_cast<float>(value);
-        break;
-      case BaseType::DOUBLE:
-        stream << std::any_cast<double>(value);
-        break;
-      case BaseType::STRING:
-          stream << std::any_cast<std::string>(value);
-          break;
-      case BaseType::NOT_A_TYPE:
-        // THIS SHOULD NOT HAPPEN !!!!
-        throw std::logic_error(" field "+ field.getName() +"as type NOT_A_TYPE !");
-        break;
+      // Aliasing pointers: the values keep the definition alive without copying its fields
+      fieldValues.emplace_back(std::shared_ptr<const MessageField>(this->def, &this->def->getField(i)),
+                               codec.getFieldCodec(i));
     }
   }
 
-  template<typename StreamType>
-  void addVectorToStream([[maybe_unused]] StreamType &stream,const Message &msg,int index, [[maybe_unused]] bool uint8_as_int=false)
+  size_t Message::getNbValues() const
   {
-    const auto& value = msg.getRawValue(index);
-    switch (value.getType().getBaseType())
+    size_t nbValues=0;
+    for (const auto &value : fieldValues)
     {
-      case BaseType::CHAR :
-      {
-        std::vector<char> vec;
-
-      }
-        break;
-      case BaseType::INT8:
-        break;
-      case BaseType::INT16:
-        break;
-      case BaseType::INT32:
-        break;
-      case BaseType::UINT8:
-        break;
-      case BaseType::UINT16:
-        break;
-      case BaseType::UINT32:
-        break;
-      case BaseType::FLOAT:
-        break;
-      case BaseType::STRING:
-        break;
-      case BaseType::NOT_A_TYPE:
-        // THIS SHOULD NOT HAPPEN !!!!
-        throw std::logic_error(" field " + value.getName() + "as type NOT_A_TYPE !");
-        break;
+      if (value.hasValue())
+        nbValues++;
     }
+    return nbValues;
+  }
+
+  const MessageDefinition &Message::getDefinition() const
+  {
+    return *def;
   }
 
   std::string Message::toString() const
   {
     std::stringstream sstr;
 
-    sstr << def.getName() << " [";
-    if (def.getNbFields())
-    for (size_t i=0;i<def.getNbFields();++i)
+    sstr << def->getName() << " [";
+    if (def->getNbFields())
+    for (size_t i=0;i<def->getNbFields();++i)
     {
       if (i != 0)
       {
         sstr << "; ";
       }
-      auto name = def.getField(i).getName();
+      const auto &value = fieldValues[i];
 
-      sstr << name << "=";
-      auto found = fieldValues.find(name);
-      if (found == fieldValues.end())
+      sstr << value.getName() << "=";
+      if (!value.hasValue())
       {
         sstr << "NOTSET";
       }
       else
       {
-        if (found->second.getType().isArray() && found->second.getType().getBaseType()!=BaseType::CHAR)
+        if (value.getType().isArray() && value.getType().getBaseType()!=BaseType::CHAR)
           sstr << "{";
-        auto val =found->second;
+        auto val = value;
         val.setOutputInt8AsInt(true);
           sstr << val;
-        if (found->second.getType().isArray() && found->second.getType().getBaseType()!=BaseType::CHAR)
+        if (value.getType().isArray() && value.getType().getBaseType()!=BaseType::CHAR)
           sstr << "}";
       }
     }
@@ -174,23 +122,17 @@ namespace pprzlink {
 
   const FieldValue &Message::getRawValue(const std::string &name) const
   {
-    auto found = fieldValues.find(name);
-    if (found==fieldValues.end())
-    {
-      throw pprzlink::no_such_field("No value for field "+name);
-    }
-    return found->second;
+    return getRawValue(def->getFieldIndex(name));
   }
 
   const FieldValue &Message::getRawValue(int index) const
   {
-    auto name = def.getField(index).getName();
-    auto found = fieldValues.find(name);
-    if (found==fieldValues.end())
+    const auto &value = fieldValues.at(index);
+    if (!value.hasValue())
     {
-      throw pprzlink::no_such_field("No value for field "+name);
+      throw pprzlink::no_such_field("No value for field "+value.getName());
     }
-    return found->second;
+    return value;
   }
 
   const std::variant<std::string, uint8_t> &Message::getSenderId() const
@@ -210,7 +152,7 @@ namespace pprzlink {
 
   uint8_t Message::getClassId() const
   {
-    return def.getClassId();
+    return def->getClassId();
   }
 
   void Message::setSenderId(const std::variant<std::string, uint8_t> &senderId)
@@ -228,175 +170,51 @@ namespace pprzlink {
     component_id = componentId;
   }
 
-  unsigned long long makeValue(BytesBuffer const &buffer, size_t offset, size_t elemSize)
+  size_t Message::addFieldToBuffer(size_t index, BytesBuffer &buffer) const
   {
-    unsigned long long value=0;
-
-    for (size_t byteIndex=0; byteIndex < elemSize; ++byteIndex)
+    const auto &value = fieldValues.at(index);
+    if (!value.hasValue())
     {
-      value |= buffer[offset + byteIndex] << (byteIndex * 8u);
+      throw field_has_no_value("In message " + def->getName() + " field " + value.getName() + " has not value !");
     }
-    return value;
+    return value.addToBuffer(buffer);
   }
 
-  template<typename BASE_TYPE>
-  std::vector<BASE_TYPE> makeVector(BytesBuffer const &buffer, size_t offset, size_t nbElem, size_t elemSize)
+  void Message::addFieldFromBuffer(size_t index, BytesBuffer const &buffer, size_t& offset)
   {
-    std::vector<BASE_TYPE> vec;
-    for (size_t elemIndex=0; elemIndex < nbElem; ++elemIndex)
-    {
-      vec.push_back((BASE_TYPE)makeValue(buffer,offset+elemSize*elemIndex,elemSize));
-    }
-    return vec;
+    addFieldFromBuffer(index, buffer.data(), buffer.size(), offset);
   }
-  size_t Message::addFieldToBuffer(size_t index, BytesBuffer &buffer) const
+
+  void Message::addFieldFromBuffer(size_t index, const uint8_t *data, size_t length, size_t &offset)
   {
-    {
-      auto name = def.getField(index).getName();
-      auto const &it = fieldValues.find(name);
-      if (it == fieldValues.end())
-      {
-        throw field_has_no_value("In message " + def.getName() + " field " + name + " has not value !");
-      }
-      return it->second.addToBuffer(buffer);
-    }
+    fieldValues.at(index).readFromBuffer(data, length, offset);
   }
 
-  void Message::addFieldFromBuffer(size_t index, BytesBuffer const &buffer, size_t& offset)
+  void Message::addFieldFromText(size_t index, std::string_view text)
   {
-    auto const & field =  getDefinition().getField(index);
-    auto const & fieldType = field.getType();
-    auto size = field.getSize();
-    unsigned long long value=0;
+    fieldValues.at(index).readFromText(text);
+  }
 
-    // For arrays
-    if (fieldType.isArray())
-    {
-      auto elemSize = sizeofBaseType(field.getType().getBaseType());
-      if (size==0) // Variable length array
-      {
-        size = elemSize * makeValue(buffer,offset,1); // Read the length of the array
-        offset++;
-      }
-      switch (fieldType.getBaseType())
-      {
-        case BaseType::CHAR:
-        {
-          auto vec = makeVector<char>(buffer,offset,size/elemSize,elemSize);
-          addField(field.getName(),vec);
-          break;
-        }
-        case BaseType::INT8:
-        {
-          auto vec = makeVector<int8_t>(buffer,offset,size/elemSize,elemSize);
-          addField(field.getName(),vec);
-          break;
-        }
-        case BaseType::INT16:
-        {
-          auto vec = makeVector<int16_t>(buffer,offset,size/elemSize,elemSize);
-          addField(field.getName(),vec);
-          break;
-        }
-        case BaseType::INT32:
-        {
-          auto vec = makeVector<int32_t>(buffer,offset,size/elemSize,elemSize);
-          addField(field.getName(),vec);
-          break;
-        }
-        case BaseType::UINT8:
-        {
-          auto vec = makeVector<uint8_t>(buffer,offset,size/elemSize,elemSize);
-          addField(field.getName(),vec);
-          break;
-        }
-        case BaseType::UINT16:
-        {
-          auto vec = makeVector<uint16_t>(buffer,offset,size/elemSize,elemSize);
-          addField(field.getName(),vec);
-          break;
-        }
-        case BaseType::UINT32:
-        {
-          auto vec = makeVector<uint32_t>(buffer,offset,size/elemSize,elemSize);
-          addField(field.getName(),vec);
-          break;
-        }
-        case BaseType::FLOAT:
-        {
-          auto vec = makeVector<float>(buffer,offset,size/elemSize,elemSize);
-          addField(field.getName(),vec);
-          break;
-        }
-        default:
-          throw std::logic_error("Type "+ fieldType.toString()+ " is not correct for PPRZ Transport.");
-          break;
-      }
-      offset+=size;
-    }
-      // If not an array and not a string (last case should not occur as strings are for Ivy only...)
-    else if (!fieldType.isArray() && size)
-    {
-      value = makeValue(buffer,offset,size);
-      offset+=size;
+  void Message::readFromBuffer(const uint8_t *data, size_t length)
+  {
+    def->getCodec().decode(fieldValues, data, length);
+  }
 
-      switch (fieldType.getBaseType())
-      {
-        case BaseType::CHAR:
-          addField(field.getName(),(char)value);
-          break;
-        case BaseType::INT8:
-          addField(field.getName(),(int8_t)value);
-          break;
-        case BaseType::INT16:
-          addField(field.getName(),(int16_t)value);
-          break;
-        case BaseType::INT32:
-          addField(field.getName(),(int32_t)value);
-          break;
-        case BaseType::UINT8:
-          addField(field.getName(),(uint8_t)value);
-          break;
-        case BaseType::UINT16:
-          addField(field.getName(),(uint16_t)value);
-          break;
-        case BaseType::UINT32:
-          addField(field.getName(),(uint32_t)value);
-          break;
-        case BaseType::FLOAT:
-        {
-          float *vf = (float*) &value;
-          addField(field.getName(), (float) *vf);
-          break;
-        }
-        case BaseType::STRING:
-        {
-          // A string is like a variable size array of char (char[])
-          size = makeValue(buffer,offset,1); // Read the length of the string
-          offset++;
-          auto vec = makeVector<char>(buffer,offset,size,1);
-          addField(field.getName(),vec);
-          break;
-        }
-        default:
-          throw std::logic_error("Type "+ fieldType.toString()+ " is not correct for PPRZ Transport.");
-          break;
-      }
-    }
+  size_t Message::addToBuffer(BytesBuffer &buffer) const
+  {
+    const auto &codec = def->getCodec();
+    size_t size = codec.getEncodedSize(fieldValues);
+    buffer.resize(buffer.size() + size);
+    return codec.encode(fieldValues, buffer.data() + buffer.size() - size);
   }
 
-  size_t Message::getByteSize() const
+  size_t Message::addToBuffer(uint8_t *out) const
   {
-    size_t size= 0;
-    if (fieldValues.size() != getDefinition().getNbFields())
-    {
-      throw pprzlink::field_has_no_value("Cannot get size of an incomplete message.");
-    }
-    for (auto value : fieldValues)
-    {
-      size+=value.second.getByteSize();
-    }
+    return def->getCodec().encode(fieldValues, out);
+  }
 
-    return size;
+  size_t Message::getByteSize() const
+  {
+    return def->getCodec().getEncodedSize(fieldValues);
   }
 }
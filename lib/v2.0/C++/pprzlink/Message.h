@@ -25,7 +25,7 @@
 #ifndef PPRZLINKCPP_MESSAGE_H
 #define PPRZLINKCPP_MESSAGE_H
 
-#include <map>
+#include <vector>
 #include <cassert>
 #include <pprzlink/MessageDefinition.h>
 #include <pprzlink/exceptions/pprzlink_exception.h>
@@ -47,6 +47,12 @@ namespace pprzlink {
      */
     explicit Message(const MessageDefinition &def);
 
+    /**
+     * Builds a message sharing the given definition.
+     * @param def
+     */
+    explicit Message(std::shared_ptr<const MessageDefinition> def);
+
     /**
      *
      * @tparam ValueType
@@ -56,8 +62,19 @@ namespace pprzlink {
     template<typename ValueType>
     void addField(const std::string &name, ValueType value)
     {
-      auto field = def.getField(name); // Will throw no_such_field if non existing field name
-      fieldValues[name] = FieldValue(field,value);
+      addField(def->getFieldIndex(name), value); // Will throw no_such_field if non existing field name
+    }
+
+    /**
+     *
+     * @tparam ValueType
+     * @param index position of the field in the message definition
+     * @param value
+     */
+    template<typename ValueType>
+    void addField(size_t index, ValueType value)
+    {
+      fieldValues.at(index).setValue(value);
     }
 
     /**
@@ -69,13 +86,7 @@ namespace pprzlink {
     template<typename ValueType>
     void getField(const std::string &name, ValueType &value) const
     {
-      auto field = def.getField(name); // Will throw no_such_field if non existing field name
-      auto const &it = fieldValues.find(name);
-      if (it == fieldValues.end())
-      {
-        throw field_has_no_value("In message " + def.getName() + " field " + name + " has not value !");
-      }
-      it->second.getValue(value);
+      getField(def->getFieldIndex(name), value); // Will throw no_such_field if non existing field name
     }
 
     /**
@@ -87,13 +98,12 @@ namespace pprzlink {
     template<typename ValueType>
     void getField(size_t index, ValueType &value) const
     {
-      auto name = def.getField(index).getName();
-      auto const &it = fieldValues.find(name);
-      if (it == fieldValues.end())
+      auto const &fieldValue = fieldValues.at(index);
+      if (!fieldValue.hasValue())
       {
-        throw field_has_no_value("In message " + def.getName() + " field " + name + " has not value !");
+        throw field_has_no_value("In message " + def->getName() + " field " + fieldValue.getName() + " has not value !");
       }
-      it->second.getValue(value);
+      fieldValue.getValue(value);
     }
 
     /**
@@ -104,6 +114,22 @@ namespace pprzlink {
      */
     void addFieldFromBuffer(size_t index, BytesBuffer const &buffer, size_t & offset);
 
+    /**
+     *
+     * @param index
+     * @param data
+     * @param length
+     * @param offset
+     */
+    void addFieldFromBuffer(size_t index, const uint8_t *data, size_t length, size_t & offset);
+
+    /**
+     *
+     * @param index
+     * @param text text representation of the value, see FieldValue::readFromText
+     */
+    void addFieldFromText(size_t index, std::string_view text);
+
     /**
      *
      * @param index
@@ -112,6 +138,30 @@ namespace pprzlink {
      */
     size_t addFieldToBuffer(size_t index, BytesBuffer &buffer) const;
 
+    /**
+     * Decode all the fields from a binary payload, using the codec of the definition.
+     *
+     * @param data start of the payload
+     * @param length size of the payload in bytes
+     */
+    void readFromBuffer(const uint8_t *data, size_t length);
+
+    /**
+     * Encode all the fields at the end of buffer, using the codec of the definition.
+     *
+     * @param buffer
+     * @return the number of bytes added
+     */
+    size_t addToBuffer(BytesBuffer &buffer) const;
+
+    /**
+     * Encode all the fields at out, which must hold getByteSize() bytes.
+     *
+     * @param out
+     * @return the number of bytes written
+     */
+    size_t addToBuffer(uint8_t *out) const;
+
     /**
      *
      * @param index
@@ -193,8 +243,8 @@ namespace pprzlink {
     size_t getByteSize() const;
 
   private:
-    MessageDefinition def;
-    std::map<std::string, FieldValue> fieldValues;
+    std::shared_ptr<const MessageDefinition> def; // Shared with the dictionary, never null
+    std::vector<FieldValue> fieldValues; // One value per field, in definition order
     std::variant<std::string,uint8_t> sender_id;
     uint8_t receiver_id;
     uint8_t component_id;
@@ -0,0 +1,396 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file MessageCodec.cpp
+ *
+ *
+ */
+
+#include <pprzlink/MessageCodec.h>
+#include <pprzlink/exceptions/pprzlink_exception.h>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+  using pprzlink::FieldStorage;
+
+  template<typename T>
+  void writeLittleEndian(uint8_t *out, T val)
+  {
+    std::memcpy(out, &val, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::reverse(out, out + sizeof(T));
+#endif
+  }
+
+  template<typename T>
+  T readLittleEndian(const uint8_t *data)
+  {
+    T val;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint8_t bytes[sizeof(T)];
+    std::reverse_copy(data, data + sizeof(T), bytes);
+    std::memcpy(&val, bytes, sizeof(T));
+#else
+    std::memcpy(&val, data, sizeof(T));
+#endif
+    return val;
+  }
+
+  template<typename T>
+  void decodeScalar(FieldStorage &storage, const uint8_t *data, size_t)
+  {
+    storage = readLittleEndian<T>(data);
+  }
+
+  template<typename T>
+  void decodeArray(FieldStorage &storage, const uint8_t *data, size_t nbElem)
+  {
+    // Reuse the vector already held by the value, if any
+    auto *vec = std::get_if<std::vector<T>>(&storage);
+    if (vec == nullptr)
+    {
+      vec = &storage.emplace<std::vector<T>>();
+    }
+    vec->resize(nbElem);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i < nbElem; ++i)
+    {
+      (*vec)[i] = readLittleEndian<T>(data + i * sizeof(T));
+    }
+#else
+    if (nbElem)
+    {
+      std::memcpy(vec->data(), data, nbElem * sizeof(T));
+    }
+#endif
+  }
+
+  void decodeString(FieldStorage &storage, const uint8_t *data, size_t nbElem)
+  {
+    storage.emplace<std::string>(reinterpret_cast<const char *>(data), nbElem);
+  }
+
+  // The encode and count functions are only called once the alternative of the storage has been checked
+
+  template<typename T>
+  void encodeScalar(const FieldStorage &storage, uint8_t *out, size_t)
+  {
+    writeLittleEndian(out, *std::get_if<T>(&storage));
+  }
+
+  template<typename T>
+  void encodeArray(const FieldStorage &storage, uint8_t *out, size_t nbElem)
+  {
+    const auto &vec = *std::get_if<std::vector<T>>(&storage);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i < nbElem; ++i)
+    {
+      writeLittleEndian(out + i * sizeof(T), vec[i]);
+    }
+#else
+    if (nbElem)
+    {
+      std::memcpy(out, vec.data(), nbElem * sizeof(T));
+    }
+#endif
+  }
+
+  void encodeString(const FieldStorage &storage, uint8_t *out, size_t nbElem)
+  {
+    std::memcpy(out, std::get_if<std::string>(&storage)->data(), nbElem);
+  }
+
+  template<typename T>
+  size_t countArray(const FieldStorage &storage)
+  {
+    return std::get_if<std::vector<T>>(&storage)->size();
+  }
+
+  size_t countString(const FieldStorage &storage)
+  {
+    return std::get_if<std::string>(&storage)->size();
+  }
+}
+
+namespace pprzlink {
+
+  FieldCodec::FieldCodec(const MessageField &field)
+    : name(field.getName()), elemSize(1), nbElem(1), storageIndex(0), decodeFn(nullptr), encodeFn(nullptr),
+      countFn(nullptr)
+  {
+    const auto &type = field.getType();
+    if (type.getBaseType() == BaseType::STRING)
+    {
+      nbElem = 0;
+      storageIndex = static_cast<size_t>(BaseType::STRING);
+      decodeFn = &decodeString;
+      encodeFn = &encodeString;
+      countFn = &countString;
+      return;
+    }
+
+    elemSize = sizeofBaseType(type.getBaseType());
+    storageIndex = static_cast<size_t>(type.getBaseType()); // See FieldStorage
+    if (type.isArray())
+    {
+      nbElem = type.getArraySize();
+      storageIndex += 10;
+    }
+
+    switch (type.getBaseType())
+    {
+#define PPRZLINK_FIELD_CODEC_CASE(baseType, T) \
+      case BaseType::baseType: \
+        decodeFn = type.isArray() ? &decodeArray<T> : &decodeScalar<T>; \
+        encodeFn = type.isArray() ? &encodeArray<T> : &encodeScalar<T>; \
+        countFn = type.isArray() ? &countArray<T> : nullptr; \
+        break;
+      PPRZLINK_FIELD_CODEC_CASE(CHAR, char)
+      PPRZLINK_FIELD_CODEC_CASE(INT8, int8_t)
+      PPRZLINK_FIELD_CODEC_CASE(INT16, int16_t)
+      PPRZLINK_FIELD_CODEC_CASE(INT32, int32_t)
+      PPRZLINK_FIELD_CODEC_CASE(UINT8, uint8_t)
+      PPRZLINK_FIELD_CODEC_CASE(UINT16, uint16_t)
+      PPRZLINK_FIELD_CODEC_CASE(UINT32, uint32_t)
+      PPRZLINK_FIELD_CODEC_CASE(FLOAT, float)
+      PPRZLINK_FIELD_CODEC_CASE(DOUBLE, double)
+#undef PPRZLINK_FIELD_CODEC_CASE
+      case BaseType::STRING:
+      case BaseType::NOT_A_TYPE:
+        throw bad_message_file("Type " + type.toString() + " is not correct for field " + name);
+    }
+  }
+
+  bool FieldCodec::isVariable() const
+  {
+    return nbElem == 0;
+  }
+
+  size_t FieldCodec::getFixedSize() const
+  {
+    return nbElem * elemSize;
+  }
+
+  void FieldCodec::checkHasValue(const FieldStorage &storage) const
+  {
+    if (storage.index() != storageIndex)
+    {
+      throw field_has_no_value("Field " + name + " has no value");
+    }
+  }
+
+  size_t FieldCodec::countElements(const FieldStorage &storage) const
+  {
+    size_t count = countFn(storage);
+    if (nbElem == 0 && count > 255)
+    {
+      throw wrong_message_format("Too many elements (" + std::to_string(count) + ") in field " + name);
+    }
+    if (nbElem != 0 && count != nbElem)
+    {
+      throw wrong_message_format("Wrong number of elements (" + std::to_string(count) + ") in field " + name);
+    }
+    return count;
+  }
+
+  size_t FieldCodec::getEncodedSize(const FieldStorage &storage) const
+  {
+    checkHasValue(storage);
+    if (isVariable())
+    {
+      return 1 + countElements(storage) * elemSize;
+    }
+    return getFixedSize();
+  }
+
+  size_t FieldCodec::encode(const FieldStorage &storage, uint8_t *out) const
+  {
+    checkHasValue(storage);
+    if (isVariable())
+    {
+      size_t count = countElements(storage);
+      out[0] = count;
+      encodeFn(storage, out + 1, count);
+      return 1 + count * elemSize;
+    }
+    if (countFn)
+    {
+      countElements(storage);
+    }
+    encodeFn(storage, out, nbElem);
+    return getFixedSize();
+  }
+
+  void FieldCodec::decode(FieldStorage &storage, const uint8_t *data, size_t length, size_t &offset) const
+  {
+    size_t count = nbElem;
+    if (isVariable())
+    {
+      if (offset >= length)
+      {
+        throw wrong_message_format("Not enough data to read field " + name);
+      }
+      count = data[offset++];
+    }
+    size_t size = count * elemSize;
+    if (offset + size > length)
+    {
+      throw wrong_message_format("Not enough data to read field " + name);
+    }
+    decodeFn(storage, data + offset, count);
+    offset += size;
+  }
+
+  void FieldCodec::skip(const uint8_t *data, size_t length, size_t &offset) const
+  {
+    if (!isVariable())
+    {
+      offset += getFixedSize();
+      return;
+    }
+    if (offset >= length)
+    {
+      throw wrong_message_format("Not enough data to read field " + name);
+    }
+    offset += 1 + data[offset] * elemSize;
+  }
+
+  MessageCodec::MessageCodec()
+    : prefixFields(0), prefixSize(0), fixedSize(0)
+  {
+  }
+
+  MessageCodec::MessageCodec(const std::vector<MessageField> &fields)
+    : prefixFields(0), prefixSize(0), fixedSize(0)
+  {
+    fieldCodecs.reserve(fields.size());
+    fieldOffsets.reserve(fields.size());
+    size_t offset = 0;
+    for (const auto &field : fields)
+    {
+      fieldCodecs.emplace_back(field);
+      const auto &codec = fieldCodecs.back();
+      // Offsets are known up to (and including) the first variable length field
+      fieldOffsets.push_back(offset);
+      if (offset != VARIABLE_OFFSET && !codec.isVariable())
+      {
+        offset += codec.getFixedSize();
+        prefixFields++;
+        prefixSize = offset;
+      }
+      else
+      {
+        offset = VARIABLE_OFFSET;
+      }
+      fixedSize += codec.isVariable() ? 1 : codec.getFixedSize();
+    }
+  }
+
+  size_t MessageCodec::getFixedSize() const
+  {
+    return fixedSize;
+  }
+
+  bool MessageCodec::isFixedSize() const
+  {
+    return prefixFields == fieldCodecs.size();
+  }
+
+  const FieldCodec &MessageCodec::getFieldCodec(size_t index) const
+  {
+    return fieldCodecs.at(index);
+  }
+
+  size_t MessageCodec::getFieldOffset(size_t index) const
+  {
+    return fieldOffsets.at(index);
+  }
+
+  size_t MessageCodec::getFieldOffset(size_t index, const uint8_t *data, size_t length) const
+  {
+    if (index < prefixFields)
+    {
+      return fieldOffsets[index];
+    }
+    size_t offset = prefixSize;
+    for (size_t fieldIndex = prefixFields; fieldIndex < index; ++fieldIndex)
+    {
+      fieldCodecs[fieldIndex].skip(data, length, offset);
+    }
+    return offset;
+  }
+
+  size_t MessageCodec::getEncodedSize(const std::vector<FieldValue> &values) const
+  {
+    size_t size = fixedSize;
+    for (size_t i = 0; i < fieldCodecs.size(); ++i)
+    {
+      const auto &codec = fieldCodecs[i];
+      const auto &storage = values[i].value;
+      codec.checkHasValue(storage);
+      if (codec.isVariable())
+      {
+        size += codec.countElements(storage) * codec.elemSize;
+      }
+    }
+    return size;
+  }
+
+  size_t MessageCodec::encode(const std::vector<FieldValue> &values, uint8_t *out) const
+  {
+    size_t i = 0;
+    for (; i < prefixFields; ++i)
+    {
+      fieldCodecs[i].encode(values[i].value, out + fieldOffsets[i]);
+    }
+    size_t offset = prefixSize;
+    for (; i < fieldCodecs.size(); ++i)
+    {
+      offset += fieldCodecs[i].encode(values[i].value, out + offset);
+    }
+    return offset;
+  }
+
+  void MessageCodec::decode(std::vector<FieldValue> &values, const uint8_t *data, size_t length) const
+  {
+    if (length < prefixSize)
+    {
+      throw wrong_message_format("Not enough data to read message of at least " + std::to_string(prefixSize) +
+                                 " bytes, got " + std::to_string(length));
+    }
+    size_t i = 0;
+    for (; i < prefixFields; ++i)
+    {
+      const auto &codec = fieldCodecs[i];
+      codec.decodeFn(values[i].value, data + fieldOffsets[i], codec.nbElem);
+    }
+    size_t offset = prefixSize;
+    for (; i < fieldCodecs.size(); ++i)
+    {
+      fieldCodecs[i].decode(values[i].value, data, length, offset);
+    }
+  }
+
+  void MessageCodec::decodeField(size_t index, FieldValue &value, const uint8_t *data, size_t length) const
+  {
+    size_t offset = getFieldOffset(index, data, length);
+    fieldCodecs.at(index).decode(value.value, data, length, offset);
+  }
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file MessageCodec.h
+ *
+ *
+ */
+
+#ifndef PPRZLINKCPP_MESSAGECODEC_H
+#define PPRZLINKCPP_MESSAGECODEC_H
+
+#include <pprzlink/FieldValue.h>
+#include <vector>
+
+namespace pprzlink {
+
+  /**
+   * Binary codec of a single field.
+   * The functions reading and writing the field are selected once from its type, so that using the codec
+   * never switches on the type of the field.
+   */
+  class FieldCodec {
+  public:
+    explicit FieldCodec(const MessageField &field);
+
+    /**
+     *
+     * @return true for strings and dynamic arrays, which are prefixed by their number of elements
+     */
+    [[nodiscard]] bool isVariable() const;
+
+    /**
+     *
+     * @return the size in bytes of the field if it is not variable, 0 otherwise
+     */
+    [[nodiscard]] size_t getFixedSize() const;
+
+    /**
+     *
+     * @param storage
+     * @return the size in bytes of the encoded value, including its length byte
+     */
+    [[nodiscard]] size_t getEncodedSize(const FieldStorage &storage) const;
+
+    /**
+     * Write the value at out, which must hold getEncodedSize(storage) bytes.
+     *
+     * @param storage
+     * @param out
+     * @return the number of bytes written
+     */
+    size_t encode(const FieldStorage &storage, uint8_t *out) const;
+
+    /**
+     * Read the value from its binary (little endian) representation.
+     *
+     * @param storage
+     * @param data start of the binary buffer
+     * @param length length of the binary buffer
+     * @param offset offset of the value in data, updated to point after the value
+     */
+    void decode(FieldStorage &storage, const uint8_t *data, size_t length, size_t &offset) const;
+
+    /**
+     * Skip the value without decoding it.
+     *
+     * @param data
+     * @param length
+     * @param offset offset of the value in data, updated to point after the value
+     */
+    void skip(const uint8_t *data, size_t length, size_t &offset) const;
+
+  private:
+    friend class MessageCodec;
+
+    using DecodeFn = void (*)(FieldStorage &storage, const uint8_t *data, size_t nbElem);
+    using EncodeFn = void (*)(const FieldStorage &storage, uint8_t *out, size_t nbElem);
+    using CountFn = size_t (*)(const FieldStorage &storage);
+
+    void checkHasValue(const FieldStorage &storage) const;
+
+    size_t countElements(const FieldStorage &storage) const; // Also checks the number of elements
+
+    std::string name; // For error messages
+    size_t elemSize;
+    size_t nbElem; // 1 for scalars, 0 for variable length fields
+    size_t storageIndex; // Alternative of FieldStorage holding the value
+    DecodeFn decodeFn;
+    EncodeFn encodeFn;
+    CountFn countFn; // Number of elements of an array value, nullptr for scalars
+  };
+
+  /**
+   * Binary codec of a message, compiled once when its MessageDefinition is built.
+   *
+   * The fixed size fields placed before the first variable length field are read and written at a fixed offset
+   * after a single bounds check, so that a message holding only scalars and fixed arrays is decoded as a sequence
+   * of copies. The following fields are handled in order with a cursor.
+   */
+  class MessageCodec {
+  public:
+    /// Offset of a field that comes after a variable length field (see getFieldOffset)
+    static constexpr size_t VARIABLE_OFFSET = static_cast<size_t>(-1);
+
+    MessageCodec();
+
+    explicit MessageCodec(const std::vector<MessageField> &fields);
+
+    /**
+     *
+     * @return the size of the fixed size fields plus one length byte per variable length field
+     */
+    [[nodiscard]] size_t getFixedSize() const;
+
+    /**
+     *
+     * @return true if the message has no string or dynamic array
+     */
+    [[nodiscard]] bool isFixedSize() const;
+
+    /**
+     *
+     * @param index
+     * @return the codec of a single field
+     */
+    [[nodiscard]] const FieldCodec &getFieldCodec(size_t index) const;
+
+    /**
+     *
+     * @param index
+     * @return the offset in bytes from the start of the payload, or VARIABLE_OFFSET if a variable length
+     * field comes before this field.
+     */
+    [[nodiscard]] size_t getFieldOffset(size_t index) const;
+
+    /**
+     * Offset of a field in an encoded payload, skipping the variable length fields that come before it.
+     *
+     * @param index
+     * @param data the payload
+     * @param length size of the payload in bytes
+     * @return
+     */
+    [[nodiscard]] size_t getFieldOffset(size_t index, const uint8_t *data, size_t length) const;
+
+    /**
+     *
+     * @param values one value per field, in definition order
+     * @return the size in bytes of the encoded values
+     */
+    [[nodiscard]] size_t getEncodedSize(const std::vector<FieldValue> &values) const;
+
+    /**
+     * Encode all the values at out, which must hold getEncodedSize(values) bytes.
+     *
+     * @param values one value per field, in definition order
+     * @param out
+     * @return the number of bytes written
+     */
+    size_t encode(const std::vector<FieldValue> &values, uint8_t *out) const;
+
+    /**
+     * Decode all the values from a payload.
+     *
+     * @param values one value per field, in definition order
+     * @param data the payload
+     * @param length size of the payload in bytes
+     */
+    void decode(std::vector<FieldValue> &values, const uint8_t *data, size_t length) const;
+
+    /**
+     * Decode a single value from a payload.
+     *
+     * @param index
+     * @param value the value of the field
+     * @param data the payload
+     * @param length size of the payload in bytes
+     */
+    void decodeField(size_t index, FieldValue &value, const uint8_t *data, size_t length) const;
+
+  private:
+    std::vector<FieldCodec> fieldCodecs;
+    std::vector<size_t> fieldOffsets;
+    size_t prefixFields; // Number of fields with a fixed offset and size
+    size_t prefixSize; // Size of these fields
+    size_t fixedSize;
+  };
+}
+
+#endif //PPRZLINKCPP_MESSAGECODEC_H
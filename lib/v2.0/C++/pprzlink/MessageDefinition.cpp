@@ -44,8 +44,8 @@ namespace pprzlink {
       {
         throw bad_message_file("No name for message");
       }
-      name = msgName;
     }
+    name = msgName;
     int msgId = xml->IntAttribute("ID", -1);
     if (msgId == -1)
     {
@@ -77,13 +77,27 @@ namespace pprzlink {
       {
         throw bad_message_file("Bad field");
       }
-      MessageField msgField(fieldName, fieldTypeStr);
-
-      fieldNameToIndex[fieldName] = fields.size();
-      fields.push_back(msgField);
+      fields.emplace_back(fieldName, fieldTypeStr);
 
       field = field->NextSiblingElement("field");
     }
+
+    indexFields();
+  }
+
+  MessageDefinition::MessageDefinition(uint8_t classId, uint8_t id, std::string name, std::vector<MessageField> fields)
+    : classId(classId), id(id), name(std::move(name)), fields(std::move(fields))
+  {
+    indexFields();
+  }
+
+  void MessageDefinition::indexFields()
+  {
+    for (size_t i = 0; i < fields.size(); ++i)
+    {
+      fieldNameToIndex[fields[i].getName()] = i;
+    }
+    codec = MessageCodec(fields);
   }
 
   uint8_t MessageDefinition::getClassId() const
@@ -114,6 +128,14 @@ namespace pprzlink {
     return fields[found->second];
   }
 
+  size_t MessageDefinition::getFieldIndex(const std::string &name) const
+  {
+    auto found =fieldNameToIndex.find(name);
+    if (found==fieldNameToIndex.end())
+      throw no_such_field("No field "+name+" in message "+getName());
+    return found->second;
+  }
+
   size_t MessageDefinition::getNbFields() const
   {
     return fields.size();
@@ -147,6 +169,11 @@ namespace pprzlink {
     return size;
   }
 
+  size_t MessageDefinition::getFieldOffset(size_t index) const
+  {
+    return codec.getFieldOffset(index);
+  }
+
   bool MessageDefinition::isRequest() const
   {
       std::string req = "_REQ";
@@ -156,4 +183,9 @@ namespace pprzlink {
           return false;
       }
   }
+
+  const MessageCodec &MessageDefinition::getCodec() const
+  {
+    return codec;
+  }
 }
@@ -27,17 +27,36 @@
 
 #include <vector>
 #include <pprzlink/MessageField.h>
+#include <pprzlink/MessageCodec.h>
 #include <tinyxml2.h>
 #include <map>
+#include <memory>
 
 namespace pprzlink {
 
-  class MessageDefinition {
+  /**
+   * Definition of a message, as read from the messages XML file.
+   * Definitions are immutable once built. Those of a MessageDictionary are shared by all the Message
+   * built from them (see Message(const MessageDefinition&)) instead of being copied.
+   */
+  class MessageDefinition : public std::enable_shared_from_this<MessageDefinition> {
   public:
+    /// Offset of a field that comes after a variable length field (see getFieldOffset)
+    static constexpr size_t VARIABLE_OFFSET = MessageCodec::VARIABLE_OFFSET;
+
     MessageDefinition ();
 
     explicit MessageDefinition (tinyxml2::XMLElement* xml,int classId);
 
+    /**
+     * Builds a definition from already parsed fields (e.g. from a binary dictionary).
+     * @param classId
+     * @param id
+     * @param name
+     * @param fields
+     */
+    MessageDefinition (uint8_t classId, uint8_t id, std::string name, std::vector<MessageField> fields);
+
     [[nodiscard]] uint8_t getClassId() const;
 
     [[nodiscard]] uint8_t getId() const;
@@ -50,20 +69,39 @@ namespace pprzlink {
 
     [[nodiscard]] const MessageField& getField(const std::string &name) const;
 
+    [[nodiscard]] size_t getFieldIndex(const std::string &name) const;
+
     [[nodiscard]] bool hasFieldName(const std::string &name) const;
 
     [[nodiscard]] std::string toString() const;
 
     [[nodiscard]] size_t getMinimumSize() const;
 
+    /**
+     * Offset of a field in the binary payload, precomputed when the definition is built.
+     * @param index
+     * @return the offset in bytes from the start of the payload, or VARIABLE_OFFSET if a variable length
+     * field (string or dynamic array) comes before this field.
+     */
+    [[nodiscard]] size_t getFieldOffset(size_t index) const;
+
     [[nodiscard]] bool isRequest() const;
 
+    /**
+     * Codec of the binary payload, compiled when the definition is built.
+     * @return
+     */
+    [[nodiscard]] const MessageCodec &getCodec() const;
+
   private:
+    void indexFields();
+
     uint8_t classId;
     uint8_t id;
     std::string name;
     std::vector<MessageField> fields;
     std::map<std::string,size_t> fieldNameToIndex;
+    MessageCodec codec;
   };
 }
 #endif //PPRZLINKCPP_MESSAGEDEFINITION_H
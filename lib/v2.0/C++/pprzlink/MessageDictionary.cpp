@@ -25,13 +25,163 @@
 #include <pprzlink/MessageDictionary.h>
 #include <tinyxml2.h>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <pprzlink/exceptions/pprzlink_exception.h>
 
 // TODO Implement the dictionnary as a singleton !
 
+namespace {
+  // FNV-1a
+  uint64_t hashName(std::string_view name)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : name)
+    {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  /*
+   * Binary dictionary: a header, the classes, the messages and their fields as fixed size records, then all the
+   * names and field types in a single pool of characters. Everything is in the byte order of the host.
+   */
+  constexpr char binaryMagic[8] = {'P', 'P', 'R', 'Z', 'D', 'I', 'C', 'T'};
+  constexpr uint32_t binaryVersion = 1;
+
+  struct BinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nbClasses;
+    uint64_t sourceHash;
+    uint32_t nbMessages;
+    uint32_t nbFields;
+    uint32_t stringsSize;
+    uint32_t reserved;
+  };
+
+  struct BinaryString {
+    uint32_t offset; // In the pool of characters
+    uint32_t length;
+  };
+
+  struct BinaryClass {
+    BinaryString name;
+    uint32_t id;
+  };
+
+  struct BinaryMessage {
+    BinaryString name;
+    uint32_t classId;
+    uint32_t id;
+    uint32_t firstField;
+    uint32_t nbFields;
+  };
+
+  struct BinaryField {
+    BinaryString name;
+    BinaryString type;
+  };
+
+  /**
+   * Read only mapping of a whole file, unmapped when destroyed.
+   */
+  class MappedFile {
+  public:
+    explicit MappedFile(std::string const &fileName)
+    {
+      int fd = open(fileName.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        return;
+      }
+      struct stat st{};
+      if (fstat(fd, &st) == 0 && st.st_size > 0)
+      {
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+          data = static_cast<const uint8_t *>(addr);
+          size = st.st_size;
+        }
+      }
+      close(fd);
+    }
+
+    ~MappedFile()
+    {
+      if (data)
+      {
+        munmap(const_cast<uint8_t *>(data), size);
+      }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+  };
+}
+
 namespace pprzlink {
 
   MessageDictionary::MessageDictionary(std::string const &fileName)
+  {
+    loadXmlFile(fileName);
+  }
+
+  MessageDictionary::MessageDictionary(tinyxml2::XMLElement* root)
+  {
+    this->loadXml(root, "XML");
+    indexNames();
+  }
+
+  MessageDictionary::MessageDictionary(std::string const &fileName, std::string const &cacheFileName)
+  {
+    auto hash = hashSource(fileName);
+    try
+    {
+      MessageDictionary cached;
+      if (cached.loadBinary(cacheFileName, hash))
+      {
+        *this = std::move(cached);
+        return;
+      }
+    } catch (bad_message_file &e)
+    {
+      std::cerr << "Ignoring binary dictionary " << cacheFileName << ": " << e.what() << std::endl;
+    }
+
+    loadXmlFile(fileName);
+    try
+    {
+      writeBinary(cacheFileName);
+    } catch (pprzlink_exception &e)
+    {
+      std::cerr << "Could not write binary dictionary " << cacheFileName << ": " << e.what() << std::endl;
+    }
+  }
+
+  MessageDictionary MessageDictionary::fromBinary(std::string const &binFileName)
+  {
+    MessageDictionary dict;
+    if (!dict.loadBinary(binFileName, 0))
+    {
+      throw bad_message_file("Could not read binary dictionary " + binFileName);
+    }
+    return dict;
+  }
+
+  void MessageDictionary::loadXmlFile(std::string const &fileName)
   {
       tinyxml2::XMLDocument xml;
       xml.LoadFile(fileName.c_str());
@@ -52,11 +202,8 @@ namespace pprzlink {
         }
       }
       this->loadXml(root, fileName);
-  }
-
-  MessageDictionary::MessageDictionary(tinyxml2::XMLElement* root)
-  {
-    this->loadXml(root, "XML");
+      indexNames();
+      sourceHash = hashSource(fileName);
   }
 
   void MessageDictionary::loadXml(tinyxml2::XMLElement* root, std::string const &fileName)
@@ -90,12 +237,12 @@ namespace pprzlink {
           auto messageName = message->Attribute("NAME", nullptr);
           if (messageName == nullptr)
           {
-            messageName = msg_class->Attribute("name", nullptr);
+            messageName = message->Attribute("name", nullptr);
           }
           int messageId = message->IntAttribute("ID", -1);
           if (messageId == -1)
           {
-            messageId = msg_class->IntAttribute("id", -1);
+            messageId = message->IntAttribute("id", -1);
           }
           if (messageName == nullptr || messageId == -1)
           {
@@ -103,9 +250,7 @@ namespace pprzlink {
           }
           try
           {
-            MessageDefinition def(message, classId);
-            messagesDict[messageName]=def;
-            msgNameToId.left.insert(boost::bimap<std::string, std::pair<int, int>>::left_value_type(messageName,std::make_pair(classId,messageId)));
+            addDefinition(std::make_shared<const MessageDefinition>(message, classId), classId, messageId);
           } catch (bad_message_file &e)
           {
             throw bad_message_file(fileName + " in class : " + className + " message " + messageName + " has a bad field.");
@@ -117,37 +262,226 @@ namespace pprzlink {
       }
   }
 
-  const MessageDefinition &MessageDictionary::getDefinition(std::string const & name) const
+  void MessageDictionary::addDefinition(std::shared_ptr<const MessageDefinition> def, int classId, int msgId)
+  {
+    auto &entry = messagesDict[def->getName()];
+    if (entry && entry->getClassId() < 16)
+    {
+      definitionsById[entry->getClassId()][entry->getId()] = nullptr; // Replaced definition
+    }
+    entry = std::move(def);
+    if (classId >= 0 && classId < 16 && msgId >= 0 && msgId < 256)
+    {
+      definitionsById[classId][msgId] = entry.get();
+    }
+    msgNameToId.left.insert(boost::bimap<std::string, std::pair<int, int>>::left_value_type(entry->getName(),std::make_pair(classId,msgId)));
+  }
+
+  void MessageDictionary::indexNames()
+  {
+    // At most half full so that probe sequences stay short
+    size_t tableSize = 1;
+    while (tableSize < 2 * messagesDict.size())
+    {
+      tableSize *= 2;
+    }
+    definitionsByName.assign(tableSize, {std::string_view(), nullptr});
+    for (const auto &msgPair : messagesDict)
+    {
+      size_t slot = hashName(msgPair.first) & (tableSize - 1);
+      while (definitionsByName[slot].second != nullptr)
+      {
+        slot = (slot + 1) & (tableSize - 1);
+      }
+      definitionsByName[slot] = {msgPair.second->getName(), msgPair.second.get()};
+    }
+  }
+
+  bool MessageDictionary::loadBinary(std::string const &binFileName, uint64_t expectedHash)
   {
-    auto iter = messagesDict.find(name);
-    if (iter == messagesDict.end())
+    MappedFile file(binFileName);
+    if (file.data == nullptr || file.size < sizeof(BinaryHeader))
+    {
+      return false;
+    }
+    const auto *header = reinterpret_cast<const BinaryHeader *>(file.data);
+    if (std::memcmp(header->magic, binaryMagic, sizeof(binaryMagic)) != 0 || header->version != binaryVersion)
+    {
+      throw bad_message_file(binFileName + " is not a binary dictionary of version " + std::to_string(binaryVersion));
+    }
+    if (expectedHash != 0 && header->sourceHash != expectedHash)
+    {
+      return false; // Outdated
+    }
+
+    // Check every size and offset once, then read the records directly from the mapping
+    const size_t recordsSize = header->nbClasses * sizeof(BinaryClass) + header->nbMessages * sizeof(BinaryMessage) +
+                               header->nbFields * sizeof(BinaryField);
+    if (file.size != sizeof(BinaryHeader) + recordsSize + header->stringsSize)
+    {
+      throw bad_message_file(binFileName + " has a wrong size");
+    }
+    const auto *classes = reinterpret_cast<const BinaryClass *>(header + 1);
+    const auto *messages = reinterpret_cast<const BinaryMessage *>(classes + header->nbClasses);
+    const auto *fields = reinterpret_cast<const BinaryField *>(messages + header->nbMessages);
+    const auto *strings = reinterpret_cast<const char *>(fields + header->nbFields);
+    auto getString = [&](const BinaryString &str) {
+      if (str.offset > header->stringsSize || str.length > header->stringsSize - str.offset)
+      {
+        throw bad_message_file(binFileName + " has a string out of bounds");
+      }
+      return std::string(strings + str.offset, str.length);
+    };
+
+    for (uint32_t i = 0; i < header->nbClasses; ++i)
+    {
+      classMap.left.insert(boost::bimap<int,std::string>::left_value_type(classes[i].id, getString(classes[i].name)));
+    }
+    for (uint32_t i = 0; i < header->nbMessages; ++i)
+    {
+      const auto &message = messages[i];
+      if (message.firstField > header->nbFields || message.nbFields > header->nbFields - message.firstField)
+      {
+        throw bad_message_file(binFileName + " has a field out of bounds");
+      }
+      std::vector<MessageField> msgFields;
+      msgFields.reserve(message.nbFields);
+      for (uint32_t f = message.firstField; f < message.firstField + message.nbFields; ++f)
+      {
+        msgFields.emplace_back(getString(fields[f].name), getString(fields[f].type));
+      }
+      addDefinition(std::make_shared<const MessageDefinition>(message.classId, message.id, getString(message.name),
+                                                              std::move(msgFields)),
+                    message.classId, message.id);
+    }
+    indexNames();
+    sourceHash = header->sourceHash;
+    return true;
+  }
+
+  void MessageDictionary::writeBinary(std::string const &binFileName) const
+  {
+    std::string strings;
+    auto addString = [&](std::string const &str) {
+      BinaryString binStr{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(str.size())};
+      strings += str;
+      return binStr;
+    };
+
+    std::vector<BinaryClass> classes;
+    for (const auto &classPair : classMap.left)
+    {
+      classes.push_back({addString(classPair.second), static_cast<uint32_t>(classPair.first)});
+    }
+    std::vector<BinaryMessage> messages;
+    std::vector<BinaryField> fields;
+    for (const auto &msgPair : messagesDict)
+    {
+      const auto &def = *msgPair.second;
+      auto ids = getMessageId(msgPair.first);
+      messages.push_back({addString(def.getName()), static_cast<uint32_t>(ids.first), static_cast<uint32_t>(ids.second),
+                          static_cast<uint32_t>(fields.size()), static_cast<uint32_t>(def.getNbFields())});
+      for (size_t i = 0; i < def.getNbFields(); ++i)
+      {
+        const auto &field = def.getField(i);
+        fields.push_back({addString(field.getName()), addString(field.getType().toString())});
+      }
+    }
+
+    BinaryHeader header{};
+    std::memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+    header.version = binaryVersion;
+    header.nbClasses = classes.size();
+    header.sourceHash = sourceHash;
+    header.nbMessages = messages.size();
+    header.nbFields = fields.size();
+    header.stringsSize = strings.size();
+
+    // Write to a temporary file renamed at the end, so that a reader never sees a partial dictionary
+    std::string tmpFileName = binFileName + ".tmp" + std::to_string(getpid());
+    {
+      std::ofstream out(tmpFileName, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char *>(classes.data()), classes.size() * sizeof(BinaryClass));
+      out.write(reinterpret_cast<const char *>(messages.data()), messages.size() * sizeof(BinaryMessage));
+      out.write(reinterpret_cast<const char *>(fields.data()), fields.size() * sizeof(BinaryField));
+      out.write(strings.data(), strings.size());
+      if (!out)
+      {
+        std::remove(tmpFileName.c_str());
+        throw bad_message_file("Could not write binary dictionary " + binFileName);
+      }
+    }
+    if (std::rename(tmpFileName.c_str(), binFileName.c_str()) != 0)
+    {
+      std::remove(tmpFileName.c_str());
+      throw bad_message_file("Could not write binary dictionary " + binFileName);
+    }
+  }
+
+  uint64_t MessageDictionary::getSourceHash() const
+  {
+    return sourceHash;
+  }
+
+  uint64_t MessageDictionary::hashSource(std::string const &fileName)
+  {
+    MappedFile file(fileName);
+    if (file.data == nullptr)
+    {
+      throw bad_message_file("Could not read " + fileName);
+    }
+    return hashName(std::string_view(reinterpret_cast<const char *>(file.data), file.size));
+  }
+
+  const MessageDefinition &MessageDictionary::getDefinition(std::string_view name) const
+  {
+    auto def = tryGetDefinition(name);
+    if (def == nullptr)
     {
       std::stringstream sstr;
       sstr << "could not find message with name " << name << std::endl;
       throw no_such_message(sstr.str());
     }
-    else
+    return *def;
+  }
+
+  const MessageDefinition *MessageDictionary::tryGetDefinition(std::string_view name) const noexcept
+  {
+    if (definitionsByName.empty())
     {
-      return iter->second;
+      return nullptr;
     }
+    const size_t mask = definitionsByName.size() - 1;
+    for (size_t slot = hashName(name) & mask; definitionsByName[slot].second != nullptr; slot = (slot + 1) & mask)
+    {
+      if (definitionsByName[slot].first == name)
+      {
+        return definitionsByName[slot].second;
+      }
+    }
+    return nullptr;
   }
 
   const MessageDefinition &MessageDictionary::getDefinition(int classId, int msgId) const
   {
-    auto iter = msgNameToId.right.find(std::make_pair(classId, msgId));
-    if (iter == msgNameToId.right.end())
+    auto def = tryGetDefinition(classId, msgId);
+    if (def == nullptr)
     {
       std::stringstream sstr;
       sstr << "could not find message with id (" << classId << ":" << msgId << ")" << std::endl;
       throw no_such_message(sstr.str());
     }
-    else
+    return *def;
+  }
+
+  const MessageDefinition *MessageDictionary::tryGetDefinition(int classId, int msgId) const noexcept
+  {
+    if (classId < 0 || classId >= 16 || msgId < 0 || msgId >= 256)
     {
-      std::string name = iter->second;
-      //std::cout << "message with id (" << classId << ":" << msgId << ") = " << name << std::endl;
-      //std::cout << messagesDict.find(name)->second.toString() << std::endl;
-      return messagesDict.find(name)->second;
+      return nullptr;
     }
+    return definitionsById[classId][msgId];
   }
 
   std::pair<int, int> MessageDictionary::getMessageId(std::string name) const
@@ -216,9 +550,9 @@ namespace pprzlink {
   std::vector<MessageDefinition> MessageDictionary::getMsgsForClass(int classId) const
   {
     std::vector<MessageDefinition> result;
-    for (auto msgPair : messagesDict)
+    for (const auto &msgPair : messagesDict)
     {
-      auto &def = msgPair.second;
+      const auto &def = *msgPair.second;
       if (def.getClassId()==classId)
         result.push_back(def);
     }
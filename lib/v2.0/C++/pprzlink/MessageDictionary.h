@@ -26,6 +26,8 @@
 #define PPRZLINKCPP_MESSAGEDICTIONARY_H
 
 #include <map>
+#include <array>
+#include <string_view>
 #include <tinyxml2.h>
 #include <boost/bimap.hpp>
 #include <pprzlink/MessageDefinition.h>
@@ -36,10 +38,62 @@ namespace pprzlink {
     MessageDictionary(std::string const &fileName);
     MessageDictionary(tinyxml2::XMLElement* root);
 
-    [[nodiscard]] const MessageDefinition &getDefinition(std::string const &name) const;
+    /**
+     * Load the dictionary from a binary cache if it was written from the current content of the XML file,
+     * otherwise parse the XML file and (re)write the cache.
+     *
+     * @param fileName the messages XML file
+     * @param cacheFileName the binary dictionary (see writeBinary)
+     */
+    MessageDictionary(std::string const &fileName, std::string const &cacheFileName);
+
+    /**
+     * Load a dictionary written by writeBinary, without parsing any XML.
+     *
+     * @param binFileName
+     * @return
+     */
+    static MessageDictionary fromBinary(std::string const &binFileName);
+
+    /**
+     * Write the dictionary in a compact binary form, in the byte order of the host.
+     *
+     * @param binFileName
+     */
+    void writeBinary(std::string const &binFileName) const;
+
+    /**
+     *
+     * @return the hash of the XML file the dictionary was loaded from (see hashSource), 0 if unknown
+     */
+    [[nodiscard]] uint64_t getSourceHash() const;
+
+    /**
+     *
+     * @param fileName
+     * @return the hash of the content of a messages file, used to invalidate binary dictionaries
+     */
+    static uint64_t hashSource(std::string const &fileName);
+
+    [[nodiscard]] const MessageDefinition &getDefinition(std::string_view name) const;
+
+    /**
+     * Same as getDefinition(std::string_view) but returns nullptr instead of throwing for an unknown message.
+     * @param name
+     * @return the definition, or nullptr if there is no such message
+     */
+    [[nodiscard]] const MessageDefinition *tryGetDefinition(std::string_view name) const noexcept;
 
     [[nodiscard]] const MessageDefinition &getDefinition(int classId, int msgId) const;
 
+    /**
+     * Same as getDefinition(int,int) but returns nullptr instead of throwing for an unknown message.
+     * @param classId
+     * @param msgId
+     * @return the definition, or nullptr if there is no such message
+     */
+    [[nodiscard]] const MessageDefinition *tryGetDefinition(int classId, int msgId) const noexcept;
+
     [[nodiscard]] std::pair<int,int> getMessageId(std::string name) const;
     [[nodiscard]] std::string getMessageName(int classId, int msgId) const;
 
@@ -50,10 +104,22 @@ namespace pprzlink {
     [[nodiscard]] std::vector<MessageDefinition> getMsgsForClass(int classId) const;
 
   private:
+    MessageDictionary() = default;
+
+    void loadXmlFile(std::string const &fileName);
     void loadXml(tinyxml2::XMLElement* root, std::string const &fileName);
-    std::map<std::string, MessageDefinition> messagesDict;
+    bool loadBinary(std::string const &binFileName, uint64_t expectedHash);
+    void addDefinition(std::shared_ptr<const MessageDefinition> def, int classId, int msgId);
+    void indexNames();
+
+    uint64_t sourceHash = 0;
+    std::map<std::string, std::shared_ptr<const MessageDefinition>> messagesDict; // Shared with the Message built from them
     boost::bimap<std::string, std::pair<int, int>> msgNameToId;
     boost::bimap<int,std::string> classMap;
+    // Direct lookup by (class id, message id) of the binary transports, class ids are 4 bits and message ids 8 bits
+    std::array<std::array<const MessageDefinition *, 256>, 16> definitionsById{};
+    // Open addressing hash table of the definitions by name, the keys point to the names of the shared definitions
+    std::vector<std::pair<std::string_view, const MessageDefinition *>> definitionsByName;
   };
 }
 #endif //PPRZLINKCPP_MESSAGEDICTIONARY_H
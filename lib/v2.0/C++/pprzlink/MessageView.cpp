@@ -0,0 +1,109 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file MessageView.cpp
+ *
+ *
+ */
+
+#include <pprzlink/MessageView.h>
+
+namespace pprzlink {
+
+  MessageView::MessageView(const MessageDefinition &def, uint8_t senderId, uint8_t receiverId, uint8_t componentId,
+                           const uint8_t *payload, size_t payloadSize)
+    : def(&def), sender_id(senderId), receiver_id(receiverId), component_id(componentId), payload(payload),
+      payloadSize(payloadSize)
+  {
+  }
+
+  size_t MessageView::getFieldOffset(size_t index) const
+  {
+    return def->getCodec().getFieldOffset(index, payload, payloadSize);
+  }
+
+  void MessageView::decodeField(size_t index, FieldStorage &storage) const
+  {
+    const auto &codec = def->getCodec().getFieldCodec(index); // Throws std::out_of_range for a wrong index
+    size_t offset = getFieldOffset(index);
+    codec.decode(storage, payload, payloadSize, offset);
+  }
+
+  FieldValue MessageView::getRawValue(size_t index) const
+  {
+    // The value may outlive the view, it shares the definition if it can and copies the field otherwise
+    auto shared = def->weak_from_this().lock();
+    FieldValue value = shared ? FieldValue(std::shared_ptr<const MessageField>(shared, &def->getField(index)),
+                                           def->getCodec().getFieldCodec(index))
+                              : FieldValue(def->getField(index));
+    def->getCodec().decodeField(index, value, payload, payloadSize);
+    return value;
+  }
+
+  FieldValue MessageView::getRawValue(const std::string &name) const
+  {
+    return getRawValue(def->getFieldIndex(name));
+  }
+
+  Message MessageView::toMessage() const
+  {
+    Message msg(*def);
+    msg.setSenderId(sender_id);
+    msg.setReceiverId(receiver_id);
+    msg.setComponentId(component_id);
+
+    msg.readFromBuffer(payload, payloadSize);
+    return msg;
+  }
+
+  const MessageDefinition &MessageView::getDefinition() const
+  {
+    return *def;
+  }
+
+  uint8_t MessageView::getSenderId() const
+  {
+    return sender_id;
+  }
+
+  uint8_t MessageView::getReceiverId() const
+  {
+    return receiver_id;
+  }
+
+  uint8_t MessageView::getComponentId() const
+  {
+    return component_id;
+  }
+
+  uint8_t MessageView::getClassId() const
+  {
+    return def->getClassId();
+  }
+
+  const uint8_t *MessageView::getPayload() const
+  {
+    return payload;
+  }
+
+  size_t MessageView::getPayloadSize() const
+  {
+    return payloadSize;
+  }
+}
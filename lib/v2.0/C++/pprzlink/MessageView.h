@@ -0,0 +1,172 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file MessageView.h
+ *
+ *
+ */
+
+#ifndef PPRZLINKCPP_MESSAGEVIEW_H
+#define PPRZLINKCPP_MESSAGEVIEW_H
+
+#include <pprzlink/Message.h>
+#include <string>
+#include <type_traits>
+
+namespace pprzlink {
+  /**
+   * Read only view of a binary message, decoding fields only when they are accessed.
+   *
+   * The view does not own the payload bytes: it is only valid as long as the buffer it points to
+   * (usually the receive buffer of a transport) is not modified.
+   */
+  class MessageView {
+  public:
+    /**
+     *
+     * @param def the definition of the message
+     * @param senderId
+     * @param receiverId
+     * @param componentId
+     * @param payload start of the binary payload (first field of the message)
+     * @param payloadSize size of the payload in bytes
+     */
+    MessageView(const MessageDefinition &def, uint8_t senderId, uint8_t receiverId, uint8_t componentId,
+                const uint8_t *payload, size_t payloadSize);
+
+    /**
+     * Scalars and strings are decoded straight from the payload, arrays go through getRawValue.
+     *
+     * @tparam ValueType
+     * @param index
+     * @param value
+     */
+    template<typename ValueType>
+    void getField(size_t index, ValueType &value) const
+    {
+      if constexpr (std::is_arithmetic<ValueType>::value || std::is_same<std::string, ValueType>::value)
+      {
+        FieldStorage storage;
+        decodeField(index, storage);
+        value = std::move(std::get<ValueType>(storage));
+      }
+      else
+      {
+        getRawValue(index).getValue(value);
+      }
+    }
+
+    /**
+     *
+     * @tparam ValueType
+     * @param name
+     * @param value
+     */
+    template<typename ValueType>
+    void getField(const std::string &name, ValueType &value) const
+    {
+      getField(def->getFieldIndex(name), value); // Will throw no_such_field if non existing field name
+    }
+
+    /**
+     * Decode a single field from the payload.
+     * @param index
+     * @return
+     */
+    [[nodiscard]] FieldValue getRawValue(size_t index) const;
+
+    /**
+     *
+     * @param name
+     * @return
+     */
+    [[nodiscard]] FieldValue getRawValue(const std::string &name) const;
+
+    /**
+     * Decode all the fields in a Message owning its values.
+     * @return
+     */
+    [[nodiscard]] Message toMessage() const;
+
+    /**
+     *
+     * @param index
+     * @return the offset of the field in the payload
+     */
+    [[nodiscard]] size_t getFieldOffset(size_t index) const;
+
+    /**
+     *
+     * @return
+     */
+    [[nodiscard]] const MessageDefinition &getDefinition() const;
+
+    /**
+     *
+     * @return
+     */
+    [[nodiscard]] uint8_t getSenderId() const;
+
+    /**
+     *
+     * @return
+     */
+    [[nodiscard]] uint8_t getReceiverId() const;
+
+    /**
+     *
+     * @return
+     */
+    [[nodiscard]] uint8_t getComponentId() const;
+
+    /**
+     *
+     * @return
+     */
+    [[nodiscard]] uint8_t getClassId() const;
+
+    /**
+     *
+     * @return
+     */
+    [[nodiscard]] const uint8_t *getPayload() const;
+
+    /**
+     *
+     * @return
+     */
+    [[nodiscard]] size_t getPayloadSize() const;
+
+  private:
+    /**
+     * Decode a single field with the codec of the definition, without building a FieldValue.
+     * @param index
+     * @param storage
+     */
+    void decodeField(size_t index, FieldStorage &storage) const;
+
+    const MessageDefinition *def;
+    uint8_t sender_id;
+    uint8_t receiver_id;
+    uint8_t component_id;
+    const uint8_t *payload;
+    size_t payloadSize;
+  };
+}
+#endif //PPRZLINKCPP_MESSAGEVIEW_H
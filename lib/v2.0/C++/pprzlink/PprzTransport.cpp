@@ -26,150 +26,368 @@
 #include <iostream>
 #include <memory>
 #include <iomanip>
+#include <charconv>
+#include <cstring>
 #include "PprzTransport.h"
+#include <pprzlink_checksum.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+  /**
+   * Find the first PPRZ_STX in [first, last), checking a whole vector register of bytes at a time when possible.
+   * @return the position of the STX, or last if there is none
+   */
+  const uint8_t *findStx(const uint8_t *first, const uint8_t *last)
+  {
+#if defined(__AVX2__)
+    const __m256i stx32 = _mm256_set1_epi8(static_cast<char>(PPRZ_STX));
+    for (; last - first >= 32; first += 32)
+    {
+      auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+      auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, stx32)));
+      if (mask)
+      {
+        return first + __builtin_ctz(mask);
+      }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i stx16 = _mm_set1_epi8(static_cast<char>(PPRZ_STX));
+    for (; last - first >= 16; first += 16)
+    {
+      auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+      auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, stx16)));
+      if (mask)
+      {
+        return first + __builtin_ctz(mask);
+      }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t stx16 = vdupq_n_u8(PPRZ_STX);
+    for (; last - first >= 16; first += 16)
+    {
+      uint8x16_t eq = vceqq_u8(vld1q_u8(first), stx16);
+      // Narrow each byte of the comparison to 4 bits so that the result fits in 64 bits
+      uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+      if (mask)
+      {
+        return first + (__builtin_ctzll(mask) >> 2);
+      }
+    }
+#endif
+    for (; first != last; ++first)
+    {
+      if (*first == PPRZ_STX)
+      {
+        return first;
+      }
+    }
+    return last;
+  }
+}
 
 namespace pprzlink {
 
-  PprzTransport::PprzTransport(Device *device, const MessageDictionary &dictionary) : Transport(device, dictionary), transportBuffer(), currentMessage(nullptr)
+  PprzTransport::PprzTransport(Device *device, const MessageDictionary &dictionary) : Transport(device, dictionary), transportBuffer(), readPos(0), frameLength(0), frameDefinition(nullptr), checksumErrors(0), unknownMessages(0)
   {
     transportBuffer.reserve(256); // This is enough for all pprz message (up to version 2.0) and should avoid mallocs
+    txBuffer.reserve(256); // Same for sending, a single frame never makes it grow
   }
 
   bool PprzTransport::hasMessage()
   {
-    if (!currentMessage)
-      decodeMessage();
-    return (bool)currentMessage;
+    return decodeMessage();
   }
 
   std::unique_ptr<Message> PprzTransport::getMessage()
   {
-    if (!currentMessage)
-      decodeMessage();
+    auto view = getMessageView();
+    if (!view)
+      return nullptr;
+
+    return std::make_unique<Message>(view->toMessage());
+  }
+
+  std::optional<MessageView> PprzTransport::getMessageView()
+  {
+    if (!decodeMessage())
+      return std::nullopt;
+
+    return takeFrame();
+  }
+
+  size_t PprzTransport::getMessages(std::vector<std::unique_ptr<Message>> &messages)
+  {
+    return decodeAll([&messages](const MessageView &view) {
+      messages.push_back(std::make_unique<Message>(view.toMessage()));
+    });
+  }
+
+  size_t PprzTransport::decodeAll(const std::function<void(const MessageView &)> &callback)
+  {
+    receive();
+    size_t nbMessages = 0;
+    while (frameLength || nextFrame())
+    {
+      callback(takeFrame());
+      nbMessages++;
+    }
+    return nbMessages;
+  }
+
+  void PprzTransport::addMessageHandler(MessageHandler handler)
+  {
+    messageHandlers.push_back(std::move(handler));
+  }
 
-    return std::move(currentMessage);
+  void PprzTransport::listen()
+  {
+    device->setBytesCallback([this](const uint8_t *data, size_t length) { onBytes(data, length); });
+  }
+
+  void PprzTransport::onBytes(const uint8_t *data, size_t length)
+  {
+    dropConsumed();
+    transportBuffer.insert(transportBuffer.end(), data, data + length);
+    while (frameLength || nextFrame())
+    {
+      auto view = takeFrame();
+      for (const auto &handler : messageHandlers)
+      {
+        handler(view);
+      }
+    }
+  }
+
+  MessageView PprzTransport::takeFrame()
+  {
+    // The frame stays in the buffer until the next reception, which is what the view is valid for
+    const uint8_t *frame = transportBuffer.data() + readPos;
+    const size_t length = frameLength;
+    readPos += frameLength;
+    frameLength = 0;
+
+    const uint8_t source = frame[2];
+    const uint8_t destination = frame[3];
+    const uint8_t component_id = (frame[4] & 0xF0u) >> 4u;
+
+    return MessageView(*frameDefinition, source, destination, component_id,
+                       frame + 6, length - 8); // Skip the 6 header bytes and 2 checksum bytes
   }
 
   size_t PprzTransport::sendMessage(Message const &msg)
   {
-    BytesBuffer buffer;
-    buffer.push_back(PPRZ_STX);
-    buffer.push_back(msg.getDefinition().getMinimumSize()); // Length to be computed at the end
-    if (msg.getSenderId().index()==0)
+    txBuffer.clear();
+    appendFrame(txBuffer, msg);
+    device->writeBuffer(txBuffer);
+
+    return txBuffer.size();
+  }
+
+  std::vector<size_t> PprzTransport::sendMessages(const std::vector<const Message *> &messages)
+  {
+    std::vector<size_t> sizes;
+    sizes.reserve(messages.size());
+    txBuffer.clear();
+    for (const auto *msg : messages)
     {
-      uint8_t ac_id;
-      std::stringstream sstr(std::get<std::string>(msg.getSenderId()));
-      sstr >> ac_id;
-      buffer.push_back(ac_id);
+      sizes.push_back(appendFrame(txBuffer, *msg));
     }
-    else
+    if (!txBuffer.empty())
     {
-      buffer.push_back(std::get<uint8_t>(msg.getSenderId()));
+      device->writeBuffer(txBuffer);
     }
-    buffer.push_back(msg.getReceiverId());
-    uint8_t class_component_id = (msg.getClassId() & 0x0Fu) | ((msg.getComponentId() & 0x0Fu)<<4u);
-    buffer.push_back(class_component_id);
+    return sizes;
+  }
 
-    buffer.push_back(msg.getDefinition().getId());
+  size_t PprzTransport::appendFrame(BytesBuffer &buffer, Message const &msg)
+  {
+    const auto &def = msg.getDefinition();
+    const size_t fieldSize = msg.getByteSize();
+    if (fieldSize > 255 - 8)
+    {
+      throw wrong_message_format("Message " + def.getName() + " of " + std::to_string(fieldSize) +
+                                 " bytes does not fit in a frame");
+    }
+
+    uint8_t *frame = startFrame(buffer, senderIdOf(msg), msg.getReceiverId(), msg.getClassId(),
+                                msg.getComponentId(), def.getId(), fieldSize);
+    msg.addToBuffer(frame + 6);
+    endFrame(frame);
+    return frame[1];
+  }
 
-    size_t fieldSize=0;
-    // Add each field to the buffer
-    for (size_t fieldIndex=0; fieldIndex < msg.getDefinition().getNbFields(); ++fieldIndex)
+  size_t PprzTransport::sendPayload(uint8_t senderId, uint8_t receiverId, uint8_t classId, uint8_t componentId,
+                                   uint8_t msgId, const uint8_t *payload, size_t payloadSize)
+  {
+    if (payloadSize > 255 - 8)
     {
-      fieldSize+= msg.addFieldToBuffer(fieldIndex, buffer);
+      throw wrong_message_format("Payload of " + std::to_string(payloadSize) + " bytes does not fit in a frame");
     }
-    buffer[1]=8+fieldSize; // 6 header bytes + 2 checksum bytes + fieldSize
+    txBuffer.clear();
+    uint8_t *frame = startFrame(txBuffer, senderId, receiverId, classId, componentId, msgId, payloadSize);
+    std::memcpy(frame + 6, payload, payloadSize);
+    endFrame(frame);
+    device->writeBuffer(txBuffer);
+
+    return txBuffer.size();
+  }
 
+  size_t PprzTransport::getChecksumErrors() const
+  {
+    return checksumErrors;
+  }
+
+  size_t PprzTransport::getUnknownMessages() const
+  {
+    return unknownMessages;
+  }
+
+  uint8_t *PprzTransport::startFrame(BytesBuffer &buffer, uint8_t senderId, uint8_t receiverId, uint8_t classId,
+                                     uint8_t componentId, uint8_t msgId, size_t payloadSize)
+  {
+    const size_t start = buffer.size();
+    buffer.resize(start + 8 + payloadSize); // 6 header bytes + 2 checksum bytes + payloadSize
+    uint8_t *frame = buffer.data() + start;
+    frame[0] = PPRZ_STX;
+    frame[1] = 8 + payloadSize;
+    frame[2] = senderId;
+    frame[3] = receiverId;
+    frame[4] = (classId & 0x0Fu) | ((componentId & 0x0Fu) << 4u);
+    frame[5] = msgId;
+    return frame;
+  }
+
+  void PprzTransport::endFrame(uint8_t *frame)
+  {
+    const uint8_t length = frame[1];
     uint8_t chk_A=0;
     uint8_t chk_B=0;
+    pprzlink_checksum_update(&chk_A, &chk_B, frame + 1, length - 3);
+    frame[length-2] = chk_A;
+    frame[length-1] = chk_B;
+  }
 
-    for (size_t i=1; i<buffer.size();++i)
+  uint8_t PprzTransport::senderIdOf(Message const &msg)
+  {
+    const auto &senderId = msg.getSenderId();
+    if (const auto *id = std::get_if<uint8_t>(&senderId))
     {
-      chk_A+=buffer[i];
-      chk_B+=chk_A;
+      return *id;
     }
-    buffer.push_back(chk_A);
-    buffer.push_back(chk_B);
-    device->writeBuffer(buffer);
-
-    return buffer.size();
+    const auto &name = std::get<std::string>(senderId);
+    uint8_t id = 0;
+    auto [end, error] = std::from_chars(name.data(), name.data() + name.size(), id);
+    if (error != std::errc() || end != name.data() + name.size())
+    {
+      throw wrong_message_format("Sender id " + name + " of message " + msg.getDefinition().getName() +
+                                 " is not an aircraft id");
+    }
+    return id;
   }
 
   bool PprzTransport::decodeMessage()
   {
+    if (frameLength)
+    {
+      return true;
+    }
+
+    receive();
+    return nextFrame();
+  }
+
+  void PprzTransport::receive()
+  {
+    dropConsumed();
+
     // Read all available bytes from device
-    auto newBytes = device->readAll();
-    transportBuffer.insert(transportBuffer.end(),newBytes.begin(),newBytes.end());
+    device->readInto(transportBuffer);
+  }
 
-    // Look for PPRZ_STX at begining of message and discard anything that comes before
-    while (transportBuffer.size()>0 && transportBuffer[0]!=PPRZ_STX)
+  void PprzTransport::dropConsumed()
+  {
+    // Drop the bytes already consumed only once they make up half of the buffer, so that each byte is moved at most
+    // once on average
+    if (readPos >= transportBuffer.size() - readPos)
     {
-      transportBuffer.erase(transportBuffer.begin());
+      transportBuffer.erase(transportBuffer.begin(), transportBuffer.begin() + readPos);
+      readPos = 0;
     }
+  }
 
-    // Do we have the length of the message ?
-    if (transportBuffer.size() > 2)
+  bool PprzTransport::nextFrame()
+  {
+    while (true)
     {
-      const uint8_t length = transportBuffer[1];
+      // Look for PPRZ_STX at begining of message and discard anything that comes before
+      const uint8_t *end = transportBuffer.data() + transportBuffer.size();
+      const uint8_t *frame = findStx(transportBuffer.data() + readPos, end);
+      readPos = frame - transportBuffer.data();
+      const size_t available = end - frame;
+
+      // Do we have the length of the message ?
+      if (available < 2)
+      {
+        return false;
+      }
+      const uint8_t length = frame[1];
+      if (length < 8) // 6 header bytes + 2 checksum bytes
+      {
+        // Not a valid frame, skip STX and try again with the rest of the buffer
+        readPos++;
+        continue;
+      }
       // Do we have enough data for this message ?
-      if (transportBuffer.size() >= length)
+      if (available < length)
       {
-        const uint8_t source = transportBuffer[2];
-        const uint8_t destination = transportBuffer[3];
-        const uint8_t class_component = transportBuffer[4] ;
-        const uint8_t class_id = (class_component & 0x0Fu);
-        const uint8_t component_id = (class_component & 0xF0u) >> 4u;
-        const uint8_t message_id = transportBuffer[5];
-        const uint8_t checksum_A = transportBuffer[length-2];
-        const uint8_t checksum_B = transportBuffer[length-1];
-
-        uint8_t chk_A=0;
-        uint8_t chk_B=0;
-        for (int i=1; i< length-2; ++i)
-        {
-          chk_A+=transportBuffer[i];
-          chk_B+=chk_A;
-        }
-
-        if (chk_A!=checksum_A || chk_B!=checksum_B)
-        {
-          std::cerr << "Wrong checksum in message !\n";
-          std::cerr << (int)chk_A << " !=" << (int)checksum_A << "\n";
-          std::cerr << (int)chk_B << " != " << (int)checksum_B << "\n";
-          // Remove STX so as to prevent reread on this message
-          transportBuffer.erase(transportBuffer.begin());
-          // Try again with the rest of the buffer
-          return decodeMessage();
-        }
-
-        /*
-        std::cout << "Message : \n ";
-        std::cout << "\tsource " << (int)source << "\n";
-        std::cout << "\tdestination " << (int)destination << "\n";
-        std::cout << "\tclass " << (int)class_id << "\n";
-        std::cout << "\tcomponent " << (int)component_id << "\n";
-        std::cout << "\tmessage " << (int)message_id << "\n";
-        std::cout << "\tpayload length " << (int)length-8 << "\n";
-        std::cout << "\tminimum size " << dictionary.getDefinition(class_id,message_id).getMinimumSize() << "\n";
-        std::cout << "\t\t=> " << dictionary.getDefinition(class_id,message_id).getName() << std::endl;
-        */
-        currentMessage = std::make_unique<Message>(dictionary.getDefinition(class_id,message_id));
-        size_t offset=6; // Skip the header
-
-        currentMessage->setSenderId(source);
-        currentMessage->setReceiverId(destination);
-        currentMessage->setComponentId(component_id);
-
-        for (size_t fieldIndex=0; fieldIndex < currentMessage->getDefinition().getNbFields(); ++fieldIndex)
-        {
-          currentMessage->addFieldFromBuffer(fieldIndex,transportBuffer,offset);
-        }
-        transportBuffer.erase(transportBuffer.begin(),transportBuffer.begin()+length);
-        return true;
+        return false;
+      }
+
+      // A frame too short for its message is not worth checksumming (unknown messages are checked below)
+      const uint8_t class_id = (frame[4] & 0x0Fu);
+      const uint8_t message_id = frame[5];
+      frameDefinition = dictionary.tryGetDefinition(class_id, message_id);
+      if (frameDefinition != nullptr && length - 8u < frameDefinition->getCodec().getFixedSize())
+      {
+        readPos++;
+        continue;
       }
-    }
 
-    return false;
+      const uint8_t checksum_A = frame[length-2];
+      const uint8_t checksum_B = frame[length-1];
+
+      uint8_t chk_A=0;
+      uint8_t chk_B=0;
+      pprzlink_checksum_update(&chk_A, &chk_B, frame + 1, length - 3);
+
+      if (chk_A!=checksum_A || chk_B!=checksum_B)
+      {
+        checksumErrors++;
+        std::cerr << "Wrong checksum in message !\n";
+        std::cerr << (int)chk_A << " !=" << (int)checksum_A << "\n";
+        std::cerr << (int)chk_B << " != " << (int)checksum_B << "\n";
+        // Skip STX so as to prevent reread on this message and try again with the rest of the buffer
+        readPos++;
+        continue;
+      }
+
+      if (frameDefinition == nullptr)
+      {
+        // Unknown message (e.g. from a newer dictionary), skip the whole frame and try again with the rest
+        unknownMessages++;
+        readPos += length;
+        continue;
+      }
+
+      frameLength = length;
+      return true;
+    }
   }
 
 }
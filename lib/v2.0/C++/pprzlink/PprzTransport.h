@@ -44,6 +44,8 @@
  */
 
 #include "Transport.h"
+#include "MessageView.h"
+#include <optional>
 
 #define PPRZ_STX (0x99)
 
@@ -56,13 +58,168 @@ namespace pprzlink {
 
     std::unique_ptr<Message> getMessage() override;
 
+    /**
+     * Get the next message as a view on the receive buffer, without decoding its fields.
+     * The view is only valid until the next call to hasMessage, getMessage or getMessageView.
+     *
+     * @return the view, or an empty optional if no complete message is available
+     */
+    std::optional<MessageView> getMessageView();
+
+    /**
+     * Read the device once and decode all the complete frames received.
+     *
+     * @param messages the messages are appended to it
+     * @return the number of messages appended
+     */
+    size_t getMessages(std::vector<std::unique_ptr<Message>> &messages) override;
+
+    /**
+     * Read the device once and hand out all the complete frames received as views, without decoding their fields.
+     * Each view is only valid during the call of the callback.
+     *
+     * @param callback called for each message, in reception order
+     * @return the number of messages
+     */
+    size_t decodeAll(const std::function<void(const MessageView &)> &callback);
+
+    /// Called for each message received in event-driven mode, the view is only valid during the call
+    using MessageHandler = std::function<void(const MessageView &)>;
+
+    /**
+     * Register a handler called for each message received once listen has been called.
+     *
+     * @param handler
+     */
+    void addMessageHandler(MessageHandler handler);
+
+    /**
+     * Switch to event-driven reception: the device pushes the bytes to onBytes as they arrive and the message
+     * handlers are called at once, from the thread the device receives in. Must be called before the device starts
+     * its reception.
+     */
+    void listen();
+
+    /**
+     * Decode the frames completed by newly received bytes and call the message handlers for each of them.
+     *
+     * @param data
+     * @param length
+     */
+    void onBytes(const uint8_t *data, size_t length);
+
+    /**
+     * Frame the message in a buffer reused across calls and write it on the device.
+     * Sending a message does not allocate memory once the buffer has grown to the size of a frame.
+     *
+     * @param msg
+     * @return the number of bytes sent
+     * @throws write_queue_full if the device dropped the frame (nothing is counted as sent then)
+     */
     size_t sendMessage(Message const &msg) override;
+
+    using Transport::sendMessages;
+
+    /**
+     * Frame all the messages one after the other in a buffer reused across calls, and send it with a single write.
+     * If a message cannot be framed nothing is sent.
+     *
+     * @param messages
+     * @return the number of bytes of each frame
+     * @throws write_queue_full if the device dropped the frames
+     */
+    std::vector<size_t> sendMessages(const std::vector<const Message *> &messages) override;
+
+    /**
+     * Send an already encoded payload, framing it with the PPRZ header and checksum.
+     *
+     * @param senderId
+     * @param receiverId
+     * @param classId
+     * @param componentId
+     * @param msgId
+     * @param payload the encoded fields of the message
+     * @param payloadSize size of the payload in bytes
+     * @return the number of bytes sent
+     */
+    size_t sendPayload(uint8_t senderId, uint8_t receiverId, uint8_t classId, uint8_t componentId, uint8_t msgId,
+                       const uint8_t *payload, size_t payloadSize);
+
+    /**
+     *
+     * @return the number of frames dropped because of a wrong checksum
+     */
+    [[nodiscard]] size_t getChecksumErrors() const;
+
+    /**
+     *
+     * @return the number of valid frames skipped because their message is not in the dictionary
+     */
+    [[nodiscard]] size_t getUnknownMessages() const;
   protected:
+    /**
+     * Look for a complete frame with a valid checksum and a known message at readPos in transportBuffer.
+     * Frames of messages missing from the dictionary are dropped.
+     * @return true if a frame is available, its length is then stored in frameLength
+     */
     bool decodeMessage();
 
+    /**
+     * Append the bytes available on the device to transportBuffer, dropping consumed bytes first if needed.
+     */
+    void receive();
+
+    /**
+     * Drop the consumed bytes from transportBuffer once they make up half of it.
+     */
+    void dropConsumed();
+
+    /**
+     * Look for the next frame from readPos, without reading the device.
+     * @return true if a frame is available
+     */
+    bool nextFrame();
+
+    /**
+     * Consume the frame found by decodeMessage or nextFrame.
+     * @return a view on it, valid until the next reception
+     */
+    MessageView takeFrame();
+
+    /**
+     * Append the complete frame of a message at the end of buffer.
+     * @return the size of the frame
+     */
+    size_t appendFrame(BytesBuffer &buffer, Message const &msg);
+
+    /**
+     * Append a frame for a payload of payloadSize bytes at the end of buffer and fill its header.
+     * @return the start of the frame, the payload goes 6 bytes after it
+     */
+    static uint8_t *startFrame(BytesBuffer &buffer, uint8_t senderId, uint8_t receiverId, uint8_t classId,
+                               uint8_t componentId, uint8_t msgId, size_t payloadSize);
+
+    /**
+     * Compute the checksum of a frame once its payload is written.
+     * @param frame
+     */
+    static void endFrame(uint8_t *frame);
+
+    /**
+     *
+     * @param msg
+     * @return the numeric sender id of the message, parsed if it is given as a string
+     */
+    static uint8_t senderIdOf(Message const &msg);
 
     BytesBuffer transportBuffer;
-    std::unique_ptr<Message> currentMessage;
+    size_t readPos; // Bytes before readPos have been consumed, they are dropped from time to time on reception
+    size_t frameLength; // Length of the valid frame at readPos, 0 if none
+    const MessageDefinition *frameDefinition; // Definition of the message in this frame
+    size_t checksumErrors;
+    size_t unknownMessages;
+    BytesBuffer txBuffer; // Frames being sent, reused so that sending does not allocate
+    std::vector<MessageHandler> messageHandlers;
   };
 }
 #endif //PPRZLINKCPP_PPRZTRANSPORT_H
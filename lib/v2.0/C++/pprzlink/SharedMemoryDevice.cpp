@@ -0,0 +1,255 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file SharedMemoryDevice.cpp
+ *
+ *
+ */
+
+#include "SharedMemoryDevice.h"
+#include "exceptions/pprzlink_exception.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pprzlink {
+
+  namespace {
+    constexpr uint32_t SHM_RING_MAGIC = 0x50525A31; // "PRZ1"
+    constexpr uint32_t SHM_HEADER_SIZE = 64; // The ring starts on its own cache line
+  }
+
+  SharedMemoryDevice::SharedMemoryDevice(const std::string &name, Role role, size_t capacity)
+    : role(role), fd(-1), mappedSize(0), header(nullptr), ring(nullptr), mask(0), readPos(0), overrunBytes(0)
+  {
+    static_assert(sizeof(Header) <= SHM_HEADER_SIZE, "The header does not fit before the ring");
+
+    if (role == Role::WRITER)
+    {
+      if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+      {
+        throw bad_shared_memory("Capacity of " + name + " must be a power of 2, not " + std::to_string(capacity));
+      }
+      fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    }
+    else
+    {
+      fd = shm_open(name.c_str(), O_RDONLY, 0);
+    }
+    if (fd < 0)
+    {
+      throw std::system_error(errno, std::system_category(), "shm_open " + name);
+    }
+
+    struct stat status{};
+    if (fstat(fd, &status) < 0)
+    {
+      int error = errno;
+      close(fd);
+      throw std::system_error(error, std::system_category(), "fstat " + name);
+    }
+
+    if (role == Role::WRITER)
+    {
+      mappedSize = SHM_HEADER_SIZE + capacity;
+      // An existing ring of the same size is reused so that its readers keep working across restarts of the writer
+      bool reuse = static_cast<size_t>(status.st_size) == mappedSize;
+      if (!reuse && ftruncate(fd, mappedSize) < 0)
+      {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::system_category(), "ftruncate " + name);
+      }
+      void *mapping = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED)
+      {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::system_category(), "mmap " + name);
+      }
+      header = static_cast<Header *>(mapping);
+      if (!reuse || header->magic != SHM_RING_MAGIC || header->headerSize != SHM_HEADER_SIZE ||
+          header->capacity != capacity)
+      {
+        header->magic = 0;
+        header->headerSize = SHM_HEADER_SIZE;
+        header->capacity = capacity;
+        new(&header->reservedPos) std::atomic<uint64_t>(0);
+        new(&header->committedPos) std::atomic<uint64_t>(0);
+        // Readers check the magic number last
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = SHM_RING_MAGIC;
+      }
+    }
+    else
+    {
+      if (static_cast<size_t>(status.st_size) < SHM_HEADER_SIZE)
+      {
+        close(fd);
+        throw bad_shared_memory(name + " is not a pprzlink ring");
+      }
+      mappedSize = status.st_size;
+      void *mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED)
+      {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::system_category(), "mmap " + name);
+      }
+      header = static_cast<Header *>(mapping);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      capacity = header->capacity;
+      if (header->magic != SHM_RING_MAGIC || header->headerSize != SHM_HEADER_SIZE || capacity == 0 ||
+          (capacity & (capacity - 1)) != 0 || mappedSize < SHM_HEADER_SIZE + capacity)
+      {
+        munmap(mapping, mappedSize);
+        close(fd);
+        throw bad_shared_memory(name + " is not a pprzlink ring");
+      }
+      // Only the bytes written from now on are read
+      readPos = header->committedPos.load(std::memory_order_acquire);
+    }
+
+    ring = reinterpret_cast<uint8_t *>(header) + SHM_HEADER_SIZE;
+    mask = capacity - 1;
+  }
+
+  SharedMemoryDevice::~SharedMemoryDevice()
+  {
+    munmap(header, mappedSize);
+    close(fd);
+  }
+
+  size_t SharedMemoryDevice::availableBytes()
+  {
+    const uint64_t committed = header->committedPos.load(std::memory_order_acquire);
+    return committed > readPos ? committed - readPos : 0;
+  }
+
+  BytesBuffer SharedMemoryDevice::readAll()
+  {
+    BytesBuffer data;
+    readInto(data);
+    return data;
+  }
+
+  size_t SharedMemoryDevice::readInto(BytesBuffer &buffer)
+  {
+    const uint64_t committed = header->committedPos.load(std::memory_order_acquire);
+    if (committed <= readPos)
+    {
+      // Nothing new (or a new ring was created by the writer)
+      readPos = committed;
+      return 0;
+    }
+
+    const uint64_t capacity = mask + 1;
+    uint64_t start = readPos;
+    if (committed - start > capacity)
+    {
+      overrunBytes += committed - capacity - start;
+      start = committed - capacity;
+    }
+
+    const size_t initialSize = buffer.size();
+    const size_t length = committed - start;
+    buffer.resize(initialSize + length);
+    const size_t offset = start & mask;
+    const size_t first = std::min<size_t>(length, capacity - offset);
+    std::memcpy(buffer.data() + initialSize, ring + offset, first);
+    std::memcpy(buffer.data() + initialSize + first, ring, length - first);
+
+    // The writer may have overwritten the beginning of what was just copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t reserved = header->reservedPos.load(std::memory_order_relaxed);
+    if (reserved > capacity && reserved - capacity > start)
+    {
+      const size_t lost = std::min<uint64_t>(reserved - capacity - start, length);
+      overrunBytes += lost;
+      buffer.erase(buffer.begin() + initialSize, buffer.begin() + initialSize + lost);
+    }
+
+    readPos = committed;
+    return buffer.size() - initialSize;
+  }
+
+  void SharedMemoryDevice::writeBuffer(const BytesBuffer &data)
+  {
+    if (role != Role::WRITER)
+    {
+      throw device_is_read_only("Only the writer of a shared memory ring can write to it");
+    }
+    if (data.empty())
+    {
+      return;
+    }
+
+    const uint64_t capacity = mask + 1;
+    uint64_t position = header->committedPos.load(std::memory_order_relaxed);
+    const uint8_t *source = data.data();
+    size_t length = data.size();
+    if (length > capacity)
+    {
+      // Only the end of the data fits in the ring
+      position += length - capacity;
+      source += length - capacity;
+      length = capacity;
+    }
+
+    // Tell the readers which bytes are about to be overwritten before touching them
+    header->reservedPos.store(position + length, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const size_t offset = position & mask;
+    const size_t first = std::min<size_t>(length, capacity - offset);
+    std::memcpy(ring + offset, source, first);
+    std::memcpy(ring, source + first, length - first);
+
+    header->committedPos.store(position + length, std::memory_order_release);
+  }
+
+  size_t SharedMemoryDevice::getOverrunBytes() const
+  {
+    return overrunBytes;
+  }
+
+  size_t SharedMemoryDevice::getCapacity() const
+  {
+    return mask + 1;
+  }
+
+  SharedMemoryDevice::Role SharedMemoryDevice::getRole() const
+  {
+    return role;
+  }
+
+  void SharedMemoryDevice::remove(const std::string &name)
+  {
+    if (shm_unlink(name.c_str()) < 0 && errno != ENOENT)
+    {
+      throw std::system_error(errno, std::system_category(), "shm_unlink " + name);
+    }
+  }
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file SharedMemoryDevice.h
+ *
+ *
+ */
+
+#ifndef PPRZLINKCPP_SHAREDMEMORYDEVICE_H
+#define PPRZLINKCPP_SHAREDMEMORYDEVICE_H
+
+#include "Device.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#ifndef SHM_RING_SIZE
+#define SHM_RING_SIZE (1u << 20u) // Must be a power of 2
+#endif
+
+namespace pprzlink {
+  /**
+   * Ring buffer in POSIX shared memory carrying raw PPRZ frames from one writer process to any number of reader
+   * processes on the same machine.
+   *
+   * The writer never waits for the readers: it appends the frames and overwrites the oldest bytes once the ring is
+   * full. Each reader keeps its own cursor and starts with the bytes written after it opened the ring. A reader too
+   * slow to keep up loses the overwritten bytes, they are counted (see getOverrunBytes) and the transport
+   * resynchronizes on the next frame.
+   *
+   * There is nothing to wait on, readers poll with readAll or readInto (e.g. through PprzTransport::decodeAll).
+   */
+  class SharedMemoryDevice : public Device {
+  public:
+    enum class Role {
+      WRITER, ///< Create the ring (or reuse it if it exists with the same size) and write to it
+      READER ///< Open an existing ring and read from it
+    };
+
+    /**
+     *
+     * @param name name of the shared memory object, e.g. "/pprzlink_telemetry"
+     * @param role
+     * @param capacity size of the ring in bytes, a power of 2 (only used by the writer)
+     */
+    SharedMemoryDevice(const std::string &name, Role role, size_t capacity = SHM_RING_SIZE);
+
+    ~SharedMemoryDevice() override;
+
+    SharedMemoryDevice(const SharedMemoryDevice &) = delete;
+    SharedMemoryDevice &operator=(const SharedMemoryDevice &) = delete;
+
+    /**
+     *
+     * @return the number of bytes written since the last read, including the ones already overwritten
+     */
+    size_t availableBytes() override;
+
+    BytesBuffer readAll() override;
+
+    size_t readInto(BytesBuffer &buffer) override;
+
+    /**
+     * Append data to the ring, only allowed to the writer.
+     *
+     * @param data
+     */
+    void writeBuffer(BytesBuffer const &data) override;
+
+    /**
+     *
+     * @return the number of bytes this reader lost because the writer overwrote them before they were read
+     */
+    [[nodiscard]] size_t getOverrunBytes() const;
+
+    [[nodiscard]] size_t getCapacity() const;
+
+    [[nodiscard]] Role getRole() const;
+
+    /**
+     * Remove the shared memory object, the processes which opened it keep it until they close it.
+     *
+     * @param name
+     */
+    static void remove(const std::string &name);
+
+  protected:
+    /// Beginning of the shared memory object, followed by the ring
+    struct Header {
+      uint32_t magic;
+      uint32_t headerSize;
+      uint64_t capacity;
+      // Positions are counts of bytes since the creation of the ring, they never wrap
+      std::atomic<uint64_t> reservedPos; // End of the bytes being written, the ring may be overwritten up to there
+      std::atomic<uint64_t> committedPos; // End of the bytes written
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "The ring positions must be lock free to be shared");
+
+    Role role;
+    int fd;
+    size_t mappedSize;
+    Header *header;
+    uint8_t *ring;
+    uint64_t mask;
+    uint64_t readPos; // Cursor of this reader
+    size_t overrunBytes;
+  };
+}
+
+#endif //PPRZLINKCPP_SHAREDMEMORYDEVICE_H
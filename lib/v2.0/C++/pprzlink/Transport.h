@@ -42,6 +42,29 @@ namespace pprzlink {
 
     virtual std::unique_ptr<Message> getMessage()  = 0;
 
+    /**
+     * Get all the messages available.
+     * The default implementation calls getMessage while hasMessage, transports should override it to decode all
+     * the frames received in a single pass.
+     *
+     * @param messages the messages are appended to it
+     * @return the number of messages appended
+     */
+    virtual size_t getMessages(std::vector<std::unique_ptr<Message>> &messages)
+    {
+      size_t nbMessages = 0;
+      while (hasMessage())
+      {
+        auto msg = getMessage();
+        if (msg)
+        {
+          messages.push_back(std::move(msg));
+          nbMessages++;
+        }
+      }
+      return nbMessages;
+    }
+
     /**
      *
      * @param msg
@@ -49,6 +72,49 @@ namespace pprzlink {
      */
     virtual size_t sendMessage(Message const & msg) = 0;
 
+    /**
+     * Send several messages in order.
+     * The default implementation calls sendMessage for each of them, transports should override it to write all the
+     * frames at once.
+     *
+     * @param messages
+     * @return the number of bytes sent for each message
+     */
+    virtual std::vector<size_t> sendMessages(const std::vector<const Message *> &messages)
+    {
+      std::vector<size_t> sizes;
+      sizes.reserve(messages.size());
+      for (const auto *msg : messages)
+      {
+        sizes.push_back(sendMessage(*msg));
+      }
+      return sizes;
+    }
+
+    /**
+     * Send several messages in order.
+     *
+     * @param messages any range of Message, or of pointers (raw or smart) to Message
+     * @return the number of bytes sent for each message
+     */
+    template<typename Range>
+    std::vector<size_t> sendMessages(const Range &messages)
+    {
+      std::vector<const Message *> pointers;
+      for (const auto &msg : messages)
+      {
+        if constexpr (std::is_convertible_v<decltype(msg), const Message &>)
+        {
+          pointers.push_back(&msg);
+        }
+        else
+        {
+          pointers.push_back(&*msg);
+        }
+      }
+      return sendMessages(pointers);
+    }
+
     Device *getDevice() const
     {
       return device;
@@ -0,0 +1,332 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file TypedMessage.h
+ *
+ * Support code for the message structs generated by gen_messages.py --lang C++
+ * and their interoperability with Message, MessageView and PprzTransport.
+ */
+
+#ifndef PPRZLINKCPP_TYPEDMESSAGE_H
+#define PPRZLINKCPP_TYPEDMESSAGE_H
+
+#include <pprzlink/PprzTransport.h>
+#include <pprzlink/exceptions/pprzlink_exception.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace pprzlink {
+  /**
+   * Maximum size of a message payload: a frame length is stored on one byte and
+   * includes 6 header bytes and 2 checksum bytes.
+   */
+  static constexpr size_t MAX_PAYLOAD_SIZE = 255 - 8;
+
+  namespace codec {
+    /**
+     * Write a value in little endian at the given location.
+     * @tparam T an arithmetic type
+     * @param buffer
+     * @param value
+     */
+    template<typename T>
+    inline void put(uint8_t *buffer, T value)
+    {
+      static_assert(std::is_arithmetic<T>::value, "Only arithmetic types can be encoded");
+      std::memcpy(buffer, &value, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      std::reverse(buffer, buffer + sizeof(T));
+#endif
+    }
+
+    /**
+     * Read a little endian value from the given location.
+     * @tparam T an arithmetic type
+     * @param buffer
+     * @return
+     */
+    template<typename T>
+    inline T get(const uint8_t *buffer)
+    {
+      static_assert(std::is_arithmetic<T>::value, "Only arithmetic types can be decoded");
+      T value;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      uint8_t bytes[sizeof(T)];
+      std::reverse_copy(buffer, buffer + sizeof(T), bytes);
+      std::memcpy(&value, bytes, sizeof(T));
+#else
+      std::memcpy(&value, buffer, sizeof(T));
+#endif
+      return value;
+    }
+
+    /**
+     * Write nbElem consecutive values in little endian.
+     * @tparam T
+     * @param buffer
+     * @param values
+     * @param nbElem
+     */
+    template<typename T>
+    inline void putArray(uint8_t *buffer, const T *values, size_t nbElem)
+    {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      for (size_t i = 0; i < nbElem; ++i)
+      {
+        put(buffer + i * sizeof(T), values[i]);
+      }
+#else
+      if (nbElem)
+      {
+        std::memcpy(buffer, values, nbElem * sizeof(T));
+      }
+#endif
+    }
+
+    /**
+     * Read nbElem consecutive little endian values.
+     * @tparam T
+     * @param buffer
+     * @param values
+     * @param nbElem
+     */
+    template<typename T>
+    inline void getArray(const uint8_t *buffer, T *values, size_t nbElem)
+    {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      for (size_t i = 0; i < nbElem; ++i)
+      {
+        values[i] = get<T>(buffer + i * sizeof(T));
+      }
+#else
+      if (nbElem)
+      {
+        std::memcpy(values, buffer, nbElem * sizeof(T));
+      }
+#endif
+    }
+  }
+
+  /**
+   * Fixed capacity storage for the variable length arrays of generated messages.
+   * Elements live inside the object so that encoding and decoding never allocate.
+   *
+   * @tparam T type of the elements
+   * @tparam Capacity maximum number of elements (bounded by the payload size)
+   */
+  template<typename T, size_t Capacity>
+  class VariableArray {
+  public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    VariableArray() = default;
+
+    VariableArray(std::initializer_list<T> init)
+    {
+      resize(init.size());
+      std::copy(init.begin(), init.end(), elements.begin());
+    }
+
+    [[nodiscard]] static constexpr size_t capacity()
+    {
+      return Capacity;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+      return nbElements;
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+      return nbElements == 0;
+    }
+
+    /**
+     * Change the number of elements. New elements are value initialized.
+     * @param size
+     */
+    void resize(size_t size)
+    {
+      if (size > Capacity)
+      {
+        throw std::length_error("VariableArray can hold at most " + std::to_string(Capacity) + " elements");
+      }
+      for (size_t i = nbElements; i < size; ++i)
+      {
+        elements[i] = T();
+      }
+      nbElements = size;
+    }
+
+    void clear()
+    {
+      nbElements = 0;
+    }
+
+    void push_back(const T &value)
+    {
+      if (nbElements == Capacity)
+      {
+        throw std::length_error("VariableArray can hold at most " + std::to_string(Capacity) + " elements");
+      }
+      elements[nbElements++] = value;
+    }
+
+    T &operator[](size_t index)
+    {
+      return elements[index];
+    }
+
+    const T &operator[](size_t index) const
+    {
+      return elements[index];
+    }
+
+    T *data()
+    {
+      return elements.data();
+    }
+
+    [[nodiscard]] const T *data() const
+    {
+      return elements.data();
+    }
+
+    iterator begin()
+    {
+      return elements.data();
+    }
+
+    iterator end()
+    {
+      return elements.data() + nbElements;
+    }
+
+    [[nodiscard]] const_iterator begin() const
+    {
+      return elements.data();
+    }
+
+    [[nodiscard]] const_iterator end() const
+    {
+      return elements.data() + nbElements;
+    }
+
+  private:
+    std::array<T, Capacity> elements{};
+    size_t nbElements = 0;
+  };
+
+  /**
+   * Decode a generated message from a view, checking that the view holds this kind of message.
+   *
+   * @tparam Msg a generated message struct
+   * @param view
+   * @param msg the decoded message
+   * @return false if the view is another message or its payload is malformed
+   */
+  template<typename Msg>
+  bool decodeView(const MessageView &view, Msg &msg)
+  {
+    if (view.getClassId() != Msg::CLASS_ID || view.getDefinition().getId() != Msg::MSG_ID)
+    {
+      return false;
+    }
+    return msg.decode(view.getPayload(), view.getPayloadSize());
+  }
+
+  /**
+   * Decode a generated message from a dynamic Message.
+   *
+   * @tparam Msg a generated message struct
+   * @param message
+   * @param msg the decoded message
+   * @return false if message is another message
+   */
+  template<typename Msg>
+  bool fromMessage(const Message &message, Msg &msg)
+  {
+    const auto &def = message.getDefinition();
+    if (def.getClassId() != Msg::CLASS_ID || def.getId() != Msg::MSG_ID)
+    {
+      return false;
+    }
+    BytesBuffer buffer;
+    buffer.reserve(Msg::MAX_PAYLOAD_SIZE);
+    message.addToBuffer(buffer);
+    return msg.decode(buffer.data(), buffer.size());
+  }
+
+  /**
+   * Build a dynamic Message from a generated message.
+   *
+   * @tparam Msg a generated message struct
+   * @param msg
+   * @param dictionary the dictionary holding the definition of Msg
+   * @param senderId
+   * @param receiverId
+   * @param componentId
+   * @return
+   */
+  template<typename Msg>
+  Message toMessage(const Msg &msg, const MessageDictionary &dictionary, uint8_t senderId, uint8_t receiverId = 0,
+                    uint8_t componentId = 0)
+  {
+    std::array<uint8_t, Msg::MAX_PAYLOAD_SIZE> payload;
+    if (msg.payloadSize() > payload.size())
+    {
+      throw wrong_message_format(std::string("Message ") + Msg::NAME + " does not fit in a frame");
+    }
+    size_t size = msg.encode(payload.data(), payload.size());
+    MessageView view(dictionary.getDefinition(Msg::CLASS_ID, Msg::MSG_ID), senderId, receiverId, componentId,
+                     payload.data(), size);
+    return view.toMessage();
+  }
+
+  /**
+   * Send a generated message on a PPRZ transport, without going through a dynamic Message.
+   *
+   * @tparam Msg a generated message struct
+   * @param transport
+   * @param msg
+   * @param senderId
+   * @param receiverId
+   * @param componentId
+   * @return the number of bytes sent
+   */
+  template<typename Msg>
+  size_t sendTypedMessage(PprzTransport &transport, const Msg &msg, uint8_t senderId, uint8_t receiverId = 0,
+                          uint8_t componentId = 0)
+  {
+    std::array<uint8_t, Msg::MAX_PAYLOAD_SIZE> payload;
+    if (msg.payloadSize() > payload.size())
+    {
+      throw wrong_message_format(std::string("Message ") + Msg::NAME + " does not fit in a frame");
+    }
+    size_t size = msg.encode(payload.data(), payload.size());
+    return transport.sendPayload(senderId, receiverId, Msg::CLASS_ID, componentId, Msg::MSG_ID, payload.data(), size);
+  }
+}
+
+#endif //PPRZLINKCPP_TYPEDMESSAGE_H
@@ -0,0 +1,241 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file UdpDevice.cpp
+ *
+ *
+ */
+
+#include "UdpDevice.h"
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/system/system_error.hpp>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <cerrno>
+#define PPRZLINK_UDP_MMSG
+#endif
+
+namespace pprzlink {
+
+  UdpDevice::UdpDevice(boost::asio::io_service &ioService, const std::string &address, unsigned short uplinkPort,
+                       unsigned short downlinkPort)
+    : socket(ioService, Endpoint(boost::asio::ip::udp::v4(), downlinkPort)),
+      receiveBuffers(UDP_DATAGRAM_BATCH * UDP_DATAGRAM_SIZE), truncatedDatagrams(0),
+      droppedDatagrams(0)
+  {
+    socket.set_option(boost::asio::socket_base::broadcast(true));
+    socket.non_blocking(true);
+    addRemote(address, uplinkPort);
+  }
+
+  size_t UdpDevice::availableBytes()
+  {
+    return socket.available();
+  }
+
+  BytesBuffer UdpDevice::readAll()
+  {
+    BytesBuffer data;
+    readInto(data);
+    return data;
+  }
+
+  size_t UdpDevice::readInto(BytesBuffer &buffer)
+  {
+    const size_t initialSize = buffer.size();
+    receiveDatagrams([&buffer](const uint8_t *data, size_t length) {
+      buffer.insert(buffer.end(), data, data + length);
+    });
+    return buffer.size() - initialSize;
+  }
+
+  void UdpDevice::startReception()
+  {
+    socket.async_wait(boost::asio::ip::udp::socket::wait_read, [this](const boost::system::error_code &error) {
+      if (error)
+      {
+        // As for the serial port, anything else than a cancelation is an error of the socket itself
+        if (error != boost::asio::error::operation_aborted)
+        {
+          raiseError(boost::system::system_error(error), true);
+        }
+        return;
+      }
+      if (!bytesCallback)
+      {
+        // Nobody to push the datagrams to, they stay in the socket for readAll
+        return;
+      }
+      try
+      {
+        receiveDatagrams(bytesCallback);
+      }
+      catch (const boost::system::system_error &receiveError)
+      {
+        // Only this reception failed (e.g. ECONNREFUSED after an ICMP error), keep waiting for the next datagrams
+        raiseError(receiveError, false);
+      }
+      startReception();
+    });
+  }
+
+  void UdpDevice::receiveDatagrams(const BytesCallback &callback)
+  {
+#ifdef PPRZLINK_UDP_MMSG
+    iovec iovecs[UDP_DATAGRAM_BATCH];
+    mmsghdr messages[UDP_DATAGRAM_BATCH];
+    while (true)
+    {
+      // The headers are modified by each call
+      for (size_t i = 0; i < UDP_DATAGRAM_BATCH; ++i)
+      {
+        iovecs[i].iov_base = receiveBuffers.data() + i * UDP_DATAGRAM_SIZE;
+        iovecs[i].iov_len = UDP_DATAGRAM_SIZE;
+        messages[i] = mmsghdr{};
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+      }
+      int received = recvmmsg(socket.native_handle(), messages, UDP_DATAGRAM_BATCH, MSG_DONTWAIT, nullptr);
+      if (received < 0)
+      {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+          break;
+        }
+        throw boost::system::system_error(errno, boost::system::system_category());
+      }
+      for (int i = 0; i < received; ++i)
+      {
+        if (messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+          truncatedDatagrams++;
+          continue;
+        }
+        callback(receiveBuffers.data() + i * UDP_DATAGRAM_SIZE, messages[i].msg_len);
+      }
+      if (received < UDP_DATAGRAM_BATCH)
+      {
+        break;
+      }
+    }
+#else
+    while (true)
+    {
+      Endpoint sender;
+      boost::system::error_code error;
+      size_t received = socket.receive_from(boost::asio::buffer(receiveBuffers.data(), UDP_DATAGRAM_SIZE), sender, 0,
+                                            error);
+      if (error == boost::asio::error::would_block)
+      {
+        break;
+      }
+      if (error == boost::asio::error::message_size)
+      {
+        truncatedDatagrams++;
+        continue;
+      }
+      if (error)
+      {
+        throw boost::system::system_error(error);
+      }
+      callback(receiveBuffers.data(), received);
+    }
+#endif
+  }
+
+  void UdpDevice::writeBuffer(const BytesBuffer &data)
+  {
+#ifdef PPRZLINK_UDP_MMSG
+    // One message per remote, all pointing to the same data, sent by batches of UDP_DATAGRAM_BATCH remotes
+    iovec data_iovec;
+    data_iovec.iov_base = const_cast<uint8_t *>(data.data());
+    data_iovec.iov_len = data.size();
+    mmsghdr messages[UDP_DATAGRAM_BATCH];
+    for (size_t first = 0; first < remotes.size(); first += UDP_DATAGRAM_BATCH)
+    {
+      const size_t count = std::min<size_t>(UDP_DATAGRAM_BATCH, remotes.size() - first);
+      for (size_t i = 0; i < count; ++i)
+      {
+        messages[i] = mmsghdr{};
+        messages[i].msg_hdr.msg_name = remotes[first + i].data();
+        messages[i].msg_hdr.msg_namelen = remotes[first + i].size();
+        messages[i].msg_hdr.msg_iov = &data_iovec;
+        messages[i].msg_hdr.msg_iovlen = 1;
+      }
+      size_t sent = 0;
+      while (sent < count)
+      {
+        int result = sendmmsg(socket.native_handle(), messages + sent, count - sent, 0);
+        if (result < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          if (errno == EAGAIN || errno == EWOULDBLOCK)
+          {
+            // The send buffer of the socket is full, as with a lost datagram the remaining remotes miss this one
+            droppedDatagrams += remotes.size() - first - sent;
+            return;
+          }
+          throw boost::system::system_error(errno, boost::system::system_category());
+        }
+        sent += result;
+      }
+    }
+#else
+    for (const auto &remote : remotes)
+    {
+      boost::system::error_code error;
+      socket.send_to(boost::asio::buffer(data), remote, 0, error);
+      if (error == boost::asio::error::would_block)
+      {
+        droppedDatagrams++;
+      }
+      else if (error)
+      {
+        throw boost::system::system_error(error);
+      }
+    }
+#endif
+  }
+
+  void UdpDevice::addRemote(const std::string &address, unsigned short uplinkPort)
+  {
+    remotes.emplace_back(boost::asio::ip::make_address(address), uplinkPort);
+  }
+
+  const std::vector<UdpDevice::Endpoint> &UdpDevice::getRemotes() const
+  {
+    return remotes;
+  }
+
+  size_t UdpDevice::getTruncatedDatagrams() const
+  {
+    return truncatedDatagrams;
+  }
+
+  size_t UdpDevice::getDroppedDatagrams() const
+  {
+    return droppedDatagrams;
+  }
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file UdpDevice.h
+ *
+ *
+ */
+
+#ifndef PPRZLINKCPP_UDPDEVICE_H
+#define PPRZLINKCPP_UDPDEVICE_H
+
+#include "Device.h"
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <string>
+#include <vector>
+
+#define UDP_UPLINK_PORT (4243)
+#define UDP_DOWNLINK_PORT (4242)
+
+#ifndef UDP_DATAGRAM_SIZE
+#define UDP_DATAGRAM_SIZE (8192) // Larger datagrams are dropped
+#endif
+
+#ifndef UDP_DATAGRAM_BATCH
+#define UDP_DATAGRAM_BATCH (16) // Datagrams received by a single system call
+#endif
+
+namespace pprzlink {
+  /**
+   * UDP link with the same ports as the python UdpMessagesInterface: frames are received on the downlink port and
+   * sent to the uplink port of the remote endpoints.
+   *
+   * Reading is done without blocking from the thread calling readAll or readInto, all the pending datagrams are
+   * received at once (with recvmmsg when available). Each datagram holds whole frames, they are appended one after
+   * the other so a datagram never ends in the middle of a frame unless it was damaged.
+   *
+   * In event-driven mode (see Device::setBytesCallback), startReception must be called to wait for datagrams in the
+   * io_service, each datagram is then pushed to the callback. The reception errors are thrown from the io_service,
+   * unless an error callback is set (see Device::setErrorCallback).
+   *
+   * Each call to writeBuffer sends one datagram to every remote endpoint (with a single sendmmsg when available), so
+   * that the same uplink can reach many aircraft.
+   */
+  class UdpDevice : public Device {
+  public:
+    using Endpoint = boost::asio::ip::udp::endpoint;
+
+    /**
+     *
+     * @param ioService
+     * @param address address of the remote (may be a broadcast address)
+     * @param uplinkPort port of the remote the frames are sent to
+     * @param downlinkPort local port the frames are received on
+     */
+    UdpDevice(boost::asio::io_service &ioService, const std::string &address,
+              unsigned short uplinkPort = UDP_UPLINK_PORT, unsigned short downlinkPort = UDP_DOWNLINK_PORT);
+
+    /**
+     *
+     * @return the size of the next pending datagram, 0 if there is none
+     */
+    size_t availableBytes() override;
+
+    BytesBuffer readAll() override;
+
+    size_t readInto(BytesBuffer &buffer) override;
+
+    void writeBuffer(BytesBuffer const &data) override;
+
+    /**
+     * Wait for datagrams in the io_service and push them to the bytes callback.
+     */
+    void startReception();
+
+    /**
+     * Also send the frames to another remote.
+     *
+     * @param address
+     * @param uplinkPort
+     */
+    void addRemote(const std::string &address, unsigned short uplinkPort = UDP_UPLINK_PORT);
+
+    [[nodiscard]] const std::vector<Endpoint> &getRemotes() const;
+
+    /**
+     *
+     * @return the number of datagrams dropped because they were larger than UDP_DATAGRAM_SIZE
+     */
+    [[nodiscard]] size_t getTruncatedDatagrams() const;
+
+    /**
+     *
+     * @return the number of datagrams not sent because the send buffer of the socket was full (one per remote)
+     */
+    [[nodiscard]] size_t getDroppedDatagrams() const;
+
+  protected:
+    /**
+     * Receive all the pending datagrams without blocking.
+     *
+     * @param callback called for each datagram
+     */
+    void receiveDatagrams(const BytesCallback &callback);
+
+    boost::asio::ip::udp::socket socket;
+    std::vector<Endpoint> remotes;
+    std::vector<uint8_t> receiveBuffers; // UDP_DATAGRAM_BATCH slots of UDP_DATAGRAM_SIZE bytes
+    size_t truncatedDatagrams;
+    size_t droppedDatagrams;
+  };
+}
+
+#endif //PPRZLINKCPP_UDPDEVICE_H
@@ -51,5 +51,8 @@ namespace pprzlink {
   DECLARE_PPRZLINK_EXCEPT(message_is_request)
   DECLARE_PPRZLINK_EXCEPT(message_is_not_request)
   DECLARE_PPRZLINK_EXCEPT(wrong_answer_to_request)
+  DECLARE_PPRZLINK_EXCEPT(bad_shared_memory)
+  DECLARE_PPRZLINK_EXCEPT(device_is_read_only)
+  DECLARE_PPRZLINK_EXCEPT(write_queue_full)
 }
 #endif //PPRZLINKCPP_PPRZLINK_EXCEPTION_H
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file test_send_allocations.cpp
+ *
+ * Check that PprzTransport::sendMessage does not allocate memory once warmed up, by counting the calls to the
+ * global operator new.
+ */
+
+#include <pprzlink/MessageDictionary.h>
+#include <pprzlink/PprzTransport.h>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace {
+  size_t allocations = 0;
+
+  /// Throws the frames away
+  class NullDevice : public pprzlink::Device {
+  public:
+    size_t availableBytes() override
+    {
+      return 0;
+    }
+
+    pprzlink::BytesBuffer readAll() override
+    {
+      return {};
+    }
+
+    void writeBuffer(pprzlink::BytesBuffer const &data) override
+    {
+      bytesWritten += data.size();
+    }
+
+    size_t bytesWritten = 0;
+  };
+
+  /**
+   * Send msg a few times to warm up, then count the allocations of many more sends.
+   *
+   * @return true if no memory was allocated after the warm up
+   */
+  bool sendsWithoutAllocation(pprzlink::PprzTransport &transport, const pprzlink::Message &msg, const char *what)
+  {
+    for (int i = 0; i < 10; ++i)
+    {
+      transport.sendMessage(msg);
+    }
+    const size_t before = allocations;
+    for (int i = 0; i < 10000; ++i)
+    {
+      transport.sendMessage(msg);
+    }
+    const size_t count = allocations - before;
+    std::cout << what << ": " << count << " allocations in 10000 sends" << std::endl;
+    return count == 0;
+  }
+}
+
+void *operator new(std::size_t size)
+{
+  ++allocations;
+  if (void *ptr = std::malloc(size ? size : 1))
+  {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " messages.xml" << std::endl;
+    return 1;
+  }
+
+  pprzlink::MessageDictionary dictionary(argv[1]);
+  if (allocations == 0)
+  {
+    std::cerr << "operator new is not replaced, nothing can be counted" << std::endl;
+    return 1;
+  }
+  NullDevice device;
+  pprzlink::PprzTransport transport(&device, dictionary);
+  bool ok = true;
+
+  pprzlink::Message moved(dictionary.getDefinition("WP_MOVED"));
+  moved.addField("wp_id", 3);
+  moved.addField("utm_east", 1.5f);
+  moved.addField("utm_north", 2.5f);
+  moved.addField("alt", 10.0f);
+  moved.addField("utm_zone", 31);
+  moved.setSenderId(static_cast<uint8_t>(12));
+  ok = sendsWithoutAllocation(transport, moved, "numeric sender id") && ok;
+
+  moved.setSenderId(std::string("12"));
+  ok = sendsWithoutAllocation(transport, moved, "string sender id") && ok;
+
+  pprzlink::Message info(dictionary.getDefinition("INFO_MSG"));
+  info.addField("msg", std::string("variable length field"));
+  info.setSenderId(std::string("7"));
+  ok = sendsWithoutAllocation(transport, info, "variable length field") && ok;
+
+  if (device.bytesWritten == 0)
+  {
+    std::cerr << "Nothing was sent" << std::endl;
+    ok = false;
+  }
+  return ok ? 0 : 1;
+}
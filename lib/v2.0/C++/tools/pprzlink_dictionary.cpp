@@ -0,0 +1,48 @@
+/*
+ * Copyright 2020 garciafa
+ * This file is part of PprzLinkCPP
+ *
+ * PprzLinkCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * PprzLinkCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with ModemTester.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file pprzlink_dictionary.cpp
+ *
+ * Compile a messages XML file to a binary dictionary, to be loaded with MessageDictionary::fromBinary or used
+ * as the cache of MessageDictionary(fileName, cacheFileName).
+ */
+
+#include <pprzlink/MessageDictionary.h>
+#include <pprzlink/exceptions/pprzlink_exception.h>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+  if (argc != 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " messages.xml dictionary.bin" << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    pprzlink::MessageDictionary dictionary(argv[1]);
+    dictionary.writeBinary(argv[2]);
+  } catch (pprzlink::pprzlink_exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
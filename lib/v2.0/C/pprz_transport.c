@@ -40,6 +40,7 @@
 
 #include <inttypes.h>
 #include "pprzlink/pprz_transport.h"
+#include "pprzlink/pprzlink_checksum.h"
 
 // PPRZ parsing state machine
 #define UNINIT      0
@@ -64,10 +65,8 @@ static void put_bytes(struct pprzlink_msg *msg, long fd,
                       const void *bytes, uint16_t len)
 {
   const uint8_t *b = (const uint8_t *) bytes;
-  int i;
-  for (i = 0; i < len; i++) {
-    accumulate_checksum(get_pprz_trans(msg), b[i]);
-  }
+  struct pprz_transport *trans = get_pprz_trans(msg);
+  pprzlink_checksum_update(&trans->ck_a_tx, &trans->ck_b_tx, b, len);
   msg->dev->put_buffer(msg->dev->periph, fd, b, len);
 }
 
@@ -154,9 +153,10 @@ void parse_pprz(struct pprz_transport *t, uint8_t c)
       break;
     case GOT_LENGTH:
       t->trans_rx.payload[t->payload_idx] = c;
-      t->ck_a_rx += c; t->ck_b_rx += t->ck_a_rx;
       t->payload_idx++;
       if (t->payload_idx == t->trans_rx.payload_len) {
+        // checksum the whole payload at once
+        pprzlink_checksum_update(&t->ck_a_rx, &t->ck_b_rx, t->trans_rx.payload, t->trans_rx.payload_len);
         t->status++;
       }
       break;
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2020 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file pprzlink_checksum.h
+ *
+ *  PPRZ checksum over a block of bytes, shared by the C, standalone and C++ implementations
+ *
+ * The checksum of a PPRZ frame is computed as:
+ * @code
+ * for each byte b
+ *     ck_a += b;
+ *     ck_b += ck_a;
+ * @endcode
+ * which makes every byte wait for the previous one. Over a block of n bytes it is equivalent to
+ * @code
+ * ck_b += n * ck_a + sum((n - i) * b[i])
+ * ck_a += sum(b[i])
+ * @endcode
+ * where both sums can be computed in parallel. Only the lower 8 bits are kept, so the sums are
+ * accumulated on 16 bits and allowed to wrap.
+ *
+ * The closed form trades an add for a multiply per byte, which only pays off over long spans:
+ * spans shorter than PPRZLINK_CHECKSUM_SHORT_LEN (e.g. the single fields put one by one by
+ * pprz_transport on MCUs) keep the plain running sum.
+ */
+
+#ifndef PPRZLINK_CHECKSUM_H
+#define PPRZLINK_CHECKSUM_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#ifndef PPRZLINK_CHECKSUM_SHORT_LEN
+#define PPRZLINK_CHECKSUM_SHORT_LEN 32
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/** Add a block of bytes to a PPRZ checksum
+ *
+ * @param ck_a pointer to the first checksum byte
+ * @param ck_b pointer to the second checksum byte
+ * @param buf bytes to add, in order
+ * @param len number of bytes
+ */
+static inline void pprzlink_checksum_update(uint8_t *ck_a, uint8_t *ck_b, const uint8_t *buf, size_t len)
+{
+  uint8_t a = *ck_a;
+  uint8_t b = *ck_b;
+  size_t i = 0;
+
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+  if (len >= 16) {
+    // Blocks of 16 bytes: each lane accumulates the bytes, the sum of the previous blocks
+    // and the bytes weighted by their distance to the end of their block
+    uint16_t sums[8], prevs[8], weighteds[8];
+    uint16_t sum = 0, prev = 0, weighted = 0;
+    int k;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w_lo = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+    const __m128i w_hi = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+    __m128i vsum = zero, vprev = zero, vweighted = zero;
+    for (; i + 16 <= len; i += 16) {
+      const __m128i block = _mm_loadu_si128((const __m128i *)(buf + i));
+      const __m128i lo = _mm_unpacklo_epi8(block, zero);
+      const __m128i hi = _mm_unpackhi_epi8(block, zero);
+      vprev = _mm_add_epi16(vprev, vsum);
+      vsum = _mm_add_epi16(vsum, _mm_add_epi16(lo, hi));
+      vweighted = _mm_add_epi16(vweighted, _mm_add_epi16(_mm_mullo_epi16(lo, w_lo), _mm_mullo_epi16(hi, w_hi)));
+    }
+    _mm_storeu_si128((__m128i *)sums, vsum);
+    _mm_storeu_si128((__m128i *)prevs, vprev);
+    _mm_storeu_si128((__m128i *)weighteds, vweighted);
+#else
+    static const uint8_t weights[16] = { 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    const uint8x8_t w_lo = vld1_u8(weights);
+    const uint8x8_t w_hi = vld1_u8(weights + 8);
+    uint16x8_t vsum = vdupq_n_u16(0), vprev = vdupq_n_u16(0), vweighted = vdupq_n_u16(0);
+    for (; i + 16 <= len; i += 16) {
+      const uint8x16_t block = vld1q_u8(buf + i);
+      vprev = vaddq_u16(vprev, vsum);
+      vsum = vaddw_u8(vaddw_u8(vsum, vget_low_u8(block)), vget_high_u8(block));
+      vweighted = vmlal_u8(vweighted, vget_low_u8(block), w_lo);
+      vweighted = vmlal_u8(vweighted, vget_high_u8(block), w_hi);
+    }
+    vst1q_u16(sums, vsum);
+    vst1q_u16(prevs, vprev);
+    vst1q_u16(weighteds, vweighted);
+#endif
+    for (k = 0; k < 8; k++) {
+      sum += sums[k];
+      prev += prevs[k];
+      weighted += weighteds[k];
+    }
+    b = (uint8_t)(b + (uint8_t)i * a + 16 * prev + weighted);
+    a = (uint8_t)(a + sum);
+  }
+#endif
+
+  // Remaining bytes
+  if (len - i < PPRZLINK_CHECKSUM_SHORT_LEN) {
+    for (; i < len; i++) {
+      a += buf[i];
+      b += a;
+    }
+  } else {
+    const size_t n = len - i;
+    uint16_t sum = 0, weighted = 0;
+    size_t j;
+    for (j = 0; j < n; j++) {
+      sum += buf[i + j];
+      weighted += (uint16_t)(n - j) * buf[i + j];
+    }
+    b = (uint8_t)(b + (uint8_t)n * a + weighted);
+    a = (uint8_t)(a + sum);
+  }
+
+  *ck_a = a;
+  *ck_b = b;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif // PPRZLINK_CHECKSUM_H
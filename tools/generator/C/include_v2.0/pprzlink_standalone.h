@@ -33,6 +33,7 @@ extern "C" {
 
 #include <stddef.h>
 #include <inttypes.h>
+#include "pprzlink_checksum.h"
 
 #define PPRZLINK_STX 0x99
 
@@ -79,9 +80,8 @@ static inline void pprzlink_put_bytes(struct pprzlink_device_tx *dev, uint8_t *b
   int i;
   for (i = 0; i < len; i++) {
     dev->put_char(b[i]);
-    dev->ck_a += b[i];
-    dev->ck_b += dev->ck_a;
   }
+  pprzlink_checksum_update(&dev->ck_a, &dev->ck_b, b, len);
 }
 
 //
@@ -155,10 +155,10 @@ static inline void pprzlink_parse(struct pprzlink_device_rx *dev, uint8_t c)
       break;
     case PPRZLINK_GOT_LENGTH:
       dev->payload[dev->payload_idx] = c;
-      dev->ck_a += c;
-      dev->ck_b += dev->ck_a;
       dev->payload_idx++;
       if (dev->payload_idx == dev->payload_len) {
+        // checksum the whole payload at once
+        pprzlink_checksum_update(&dev->ck_a, &dev->ck_b, dev->payload, dev->payload_len);
         dev->status++;
       }
       break;
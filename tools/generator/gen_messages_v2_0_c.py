@@ -72,7 +72,7 @@ ${{message:#include "${class_name}/${msg_name}.h"
 def copy_fixed_headers(directory, protocol_version):
     '''copy the fixed protocol headers to the target directory'''
     import shutil
-    hlist = [ 'pprzlink_device.h', 'pprzlink_transport.h', 'pprzlink_utils.h', 'pprzlink_message.h' ]
+    hlist = [ 'pprzlink_device.h', 'pprzlink_transport.h', 'pprzlink_utils.h', 'pprzlink_message.h', 'pprzlink_checksum.h' ]
     basepath = os.path.dirname(os.path.realpath(__file__))
     srcpath = os.path.join(basepath, 'C/include_v%s' % protocol_version)
     if directory == '':
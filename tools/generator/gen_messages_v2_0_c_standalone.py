@@ -83,7 +83,7 @@ static inline ${return_type} pprzlink_get_${msg_name}_${field_name}(uint8_t * _p
 def copy_fixed_headers(directory, protocol_version):
     '''copy the fixed protocol headers to the target directory'''
     import shutil
-    hlist = [ 'pprzlink_utils.h', 'pprzlink_standalone.h' ]
+    hlist = [ 'pprzlink_utils.h', 'pprzlink_standalone.h', 'pprzlink_checksum.h' ]
     basepath = os.path.dirname(os.path.realpath(__file__))
     srcpath = os.path.join(basepath, 'C/include_v%s' % protocol_version)
     if directory == '':
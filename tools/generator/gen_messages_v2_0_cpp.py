@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+'''
+parse a PPRZLink protocol XML file and generate a C++ implementation
+for version 2.0 of the protocol
+
+One struct is generated per message, with native members, constexpr ids
+and payload offsets, and allocation free encode / decode functions.
+The generated header depends on pprzlink/TypedMessage.h from the C++ library.
+
+For the Paparazzi UAV and PPRZLINK projects
+
+based on:
+    Copyright Andrew Tridgell 2011
+    Released under GNU GPL version 3 or later
+'''
+
+from __future__ import print_function
+import os
+import pprz_template, pprz_parse
+
+t = pprz_template.PPRZTemplate()
+
+# Maximum payload size: 255 bytes frame minus 6 header bytes and 2 checksum bytes
+MAX_PAYLOAD_SIZE = 255 - 8
+
+# Field names that are C++ keywords or standard macros get an underscore appended
+CPP_KEYWORDS = set('''alignas alignof and and_eq asm auto bitand bitor bool break case catch char char16_t
+char32_t class compl const constexpr const_cast continue decltype default delete do double dynamic_cast
+else enum explicit export extern false float for friend goto if inline int long mutable namespace new
+noexcept not not_eq nullptr operator or or_eq private protected public register reinterpret_cast return
+short signed sizeof static static_assert static_cast struct switch template this thread_local throw true
+try typedef typeid typename union unsigned using virtual void volatile wchar_t while xor xor_eq
+errno assert major minor NULL EOF stdin stdout stderr'''.split())
+
+
+def generate_main_h(directory, name, xml):
+    '''generate the header holding all messages of the class'''
+    f = open(os.path.join(directory, name), mode='w')
+    t.write(f, '''
+/** @file
+ *  @brief PPRZLink C++ messages of class ${class_name} built from ${filename}
+ *  @see http://paparazziuav.org
+ */
+
+#pragma once
+
+#include <pprzlink/TypedMessage.h>
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+namespace pprzlink {
+namespace messages {
+namespace ${class_name} {
+
+${{message:/**
+ * ${msg_name} (class ${class_id}, id ${id})
+ */
+struct ${msg_name} {
+  static constexpr uint8_t CLASS_ID = ${class_id};
+  static constexpr uint8_t MSG_ID = ${id};
+  static constexpr const char *NAME = "${msg_name}";
+  /** Payload size with all variable arrays empty */
+  static constexpr size_t MIN_PAYLOAD_SIZE = ${min_payload_size};
+  /** Upper bound of the payload size */
+  static constexpr size_t MAX_PAYLOAD_SIZE = ${max_payload_size};
+
+  /** Offsets of the fields in the payload, known up to the first variable array */
+  struct Offsets {
+${offsets}  };
+
+${members}
+  /**
+   * @return the size of the encoded payload
+   */
+  [[nodiscard]] size_t payloadSize() const
+  {
+    return ${payload_size_expr};
+  }
+
+  /**
+   * Encode the fields in little endian.
+   * @param _payload destination buffer
+   * @param _size size of the destination buffer
+   * @return the number of bytes written, 0 if the buffer is too small
+   */
+  size_t encode(uint8_t *_payload, size_t _size) const
+  {
+    const size_t _payloadSize = payloadSize();
+    if (_payloadSize > _size || _payloadSize > ::pprzlink::MAX_PAYLOAD_SIZE)
+    {
+      return 0;
+    }
+${encode_body}    return _payloadSize;
+  }
+
+  /**
+   * Decode the fields from a payload.
+   * @param _payload start of the payload (first field)
+   * @param _size size of the payload
+   * @return false if the payload is malformed, the content of the struct is then unspecified
+   */
+  bool decode(const uint8_t *_payload, size_t _size)
+  {
+    if (_size < MIN_PAYLOAD_SIZE)
+    {
+      return false;
+    }
+${decode_body}    return true;
+  }
+};
+
+}}
+} // namespace ${class_name}
+} // namespace messages
+} // namespace pprzlink
+''', xml)
+    f.close()
+
+
+def member_name(f):
+    '''C++ name of the member holding field f'''
+    if f.field_name in CPP_KEYWORDS:
+        return f.field_name + '_'
+    return f.field_name
+
+
+def prepare_message(m):
+    '''compute the layout of message m and the code snippets used by the template'''
+    # Minimum payload size (variable arrays empty, only their length byte)
+    min_size = 0
+    for f in m.fields:
+        if f.array_type == 'VariableArray':
+            min_size += 1
+        else:
+            min_size += int(eval(f.length))
+
+    offsets = ''
+    members = ''
+    encode = ''
+    decode = ''
+    size_expr = 'MIN_PAYLOAD_SIZE'
+    max_size = min_size
+    offset = 0 # None once the offset is not known at compile time
+    remaining = min_size # minimum size of the fields not yet decoded
+    for f in m.fields:
+        name = member_name(f)
+        sz = int(f.type_length)
+        if offset is not None:
+            offsets += '    static constexpr size_t %s = %d;\n' % (name, offset)
+            pos = 'Offsets::%s' % name
+        else:
+            pos = '_offset'
+
+        if f.array_type == 'VariableArray':
+            capacity = (MAX_PAYLOAD_SIZE - min_size) // sz
+            members += '  ::pprzlink::VariableArray<%s, %d> %s; ///< %s\n' % (f.type, capacity, name, f.description)
+            size_expr += ' + %s.size() * %d' % (name, sz)
+            max_size += capacity * sz
+            remaining -= 1
+            if offset is not None:
+                encode += '    size_t _offset = %s;\n' % pos
+                decode += '    size_t _offset = %s;\n' % pos
+            encode += '    _payload[_offset] = static_cast<uint8_t>(%s.size());\n' % name
+            encode += '    ::pprzlink::codec::putArray(_payload + _offset + 1, %s.data(), %s.size());\n' % (name, name)
+            encode += '    _offset += 1 + %s.size() * %d;\n' % (name, sz)
+            decode += '    {\n'
+            decode += '      const size_t _nb = _payload[_offset];\n'
+            decode += '      if (_nb > %s.capacity() || _size < _offset + 1 + _nb * %d + %d)\n' % (name, sz, remaining)
+            decode += '      {\n        return false;\n      }\n'
+            decode += '      %s.resize(_nb);\n' % name
+            decode += '      ::pprzlink::codec::getArray(_payload + _offset + 1, %s.data(), _nb);\n' % name
+            decode += '      _offset += 1 + _nb * %d;\n' % sz
+            decode += '    }\n'
+            offset = None
+        elif f.array_type == 'FixedArray':
+            length = int(eval(f.length))
+            members += '  std::array<%s, %s> %s{}; ///< %s\n' % (f.type, f.array_length, name, f.description)
+            encode += '    ::pprzlink::codec::putArray(_payload + %s, %s.data(), %s.size());\n' % (pos, name, name)
+            decode += '    ::pprzlink::codec::getArray(_payload + %s, %s.data(), %s.size());\n' % (pos, name, name)
+            remaining -= length
+            if offset is not None:
+                offset += length
+            else:
+                encode += '    _offset += %d;\n' % length
+                decode += '    _offset += %d;\n' % length
+        else:
+            members += '  %s %s{}; ///< %s\n' % (f.type, name, f.description)
+            encode += '    ::pprzlink::codec::put<%s>(_payload + %s, %s);\n' % (f.type, pos, name)
+            decode += '    %s = ::pprzlink::codec::get<%s>(_payload + %s);\n' % (name, f.type, pos)
+            remaining -= sz
+            if offset is not None:
+                offset += sz
+            else:
+                encode += '    _offset += %d;\n' % sz
+                decode += '    _offset += %d;\n' % sz
+
+    if len(m.fields) == 0:
+        encode = '    (void) _payload;\n'
+        decode = '    (void) _payload;\n'
+
+    m.min_payload_size = min_size
+    m.max_payload_size = min(max_size, MAX_PAYLOAD_SIZE)
+    m.offsets = offsets
+    m.members = members
+    m.payload_size_expr = size_expr
+    m.encode_body = encode
+    m.decode_body = decode
+
+
+def generate(output, xml):
+    '''generate C++ implementation of a message class in a single header'''
+
+    directory, name = os.path.split(output)
+    print("Generating C++ implementation in %s" % output)
+    if directory != '':
+        pprz_parse.mkdir_p(directory)
+
+    for m in xml.message:
+        m.class_id = xml.class_id
+        prepare_message(m)
+
+    generate_main_h(directory, name, xml)